@@ -16,19 +16,73 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 #include "glm.h"
+#include "mman32.h"
+#include "pthread32.h"
+#ifdef FREEGLUT
+#include <GL/freeglut_ext.h>
+#endif
+
+/* vector instructions, unless GLM_NO_SIMD is defined */
+#if !defined(GLM_NO_SIMD) && defined(__AVX2__)
+#define GLM_AVX2
+#include <immintrin.h>
+#elif !defined(GLM_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define GLM_SSE
+#include <xmmintrin.h>
+#endif
 
 
 #define T(x) (model->triangles[(x)])
 
+/* smallest piece of a file worth parsing on a thread of its own */
+#ifndef GLM_CHUNK_SIZE
+#define GLM_CHUNK_SIZE (1 << 20)
+#endif
+
+/* size of the pieces a file is streamed in (see glmReadOBJStream()) */
+#ifndef GLM_STREAM_SIZE
+#define GLM_STREAM_SIZE (1 << 22)
+#endif
+
+/* bytes parsed between progress reports */
+#ifndef GLM_PROGRESS_STEP
+#define GLM_PROGRESS_STEP (1 << 18)
+#endif
+
+/* size of the blocks a model's small arrays and strings are cut from */
+#ifndef GLM_ARENA_BLOCK
+#define GLM_ARENA_BLOCK (1 << 16)
+#endif
+
+/* smallest array of a model that gets an allocation of its own */
+#ifndef GLM_ARENA_LARGE
+#define GLM_ARENA_LARGE (1 << 14)
+#endif
+
+/* triangles in each block of indices of a compact model */
+#ifndef GLM_COMPACT_BLOCK
+#define GLM_COMPACT_BLOCK 4096
+#endif
+
+/* alignment of everything cut from a block */
+#define GLM_ARENA_ALIGN 16
+#define GLM_ALIGN(n) \
+    (((n) + GLM_ARENA_ALIGN - 1) & ~(size_t)(GLM_ARENA_ALIGN - 1))
+
+/* fewest triangles worth making facet normals on a thread of their own */
+#ifndef GLM_FACET_GRAIN
+#define GLM_FACET_GRAIN (1 << 16)
+#endif
 
-/* _GLMnode: general purpose node */
-typedef struct _GLMnode {
-    GLuint         index;
-    GLboolean      averaged;
-    struct _GLMnode* next;
-} GLMnode;
+/* fewest vertices (or faces) of a binary file worth decoding on a
+   thread of their own */
+#ifndef GLM_DECODE_GRAIN
+#define GLM_DECODE_GRAIN (1 << 16)
+#endif
 
 
 /* glmMax: returns the maximum of two floats */
@@ -49,6 +103,316 @@ glmAbs(GLfloat f)
     return f;
 }
 
+/* GLMblock: a block of an arena, followed by the memory cut from it */
+typedef struct _GLMblock {
+    struct _GLMblock* next;     /* block allocated before this one */
+    size_t  size;               /* bytes after the header */
+    size_t  used;               /* bytes cut from them so far */
+} GLMblock;
+
+/* GLMlarge: an array of an arena that has an allocation of its own */
+typedef struct _GLMlarge {
+    struct _GLMlarge* next;
+    GLvoid* data;
+    size_t  size;               /* bytes allocated */
+} GLMlarge;
+
+/* GLMarena: the memory a model's arrays and strings (and the model
+ * itself) live in.  Small ones are cut from big blocks and stay until
+ * the model is deleted.  Large ones are allocated on their own, so the
+ * ones that get replaced (normals, texcoords...) can be freed early.
+ */
+typedef struct _GLMarena {
+    GLMblock* blocks;           /* blocks, the most recent first */
+    GLMlarge* large;            /* arrays with allocations of their own */
+    GLMlarge* spare;            /* list entries of arrays since freed */
+} GLMarena;
+
+/* glmNewBlock: allocates an arena block with room for size bytes */
+static GLMblock*
+glmNewBlock(GLMblock* next, size_t size)
+{
+    GLMblock* block;
+    
+    block = (GLMblock*)malloc(GLM_ALIGN(sizeof(GLMblock)) + size);
+    if (!block) {
+        fprintf(stderr, "glmNewBlock() failed: out of memory.\n");
+        exit(1);
+    }
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    
+    return block;
+}
+
+/* glmNewArena: allocates an arena (at the start of its first block) */
+static GLMarena*
+glmNewArena(GLvoid)
+{
+    GLMarena* arena;
+    GLMblock* block;
+    
+    block = glmNewBlock(NULL, GLM_ARENA_BLOCK);
+    arena = (GLMarena*)((char*)block + GLM_ALIGN(sizeof(GLMblock)));
+    block->used = GLM_ALIGN(sizeof(GLMarena));
+    arena->blocks = block;
+    arena->large = NULL;
+    arena->spare = NULL;
+    
+    return arena;
+}
+
+/* glmFreeArena: frees all of the memory of an arena (which itself
+ * goes with its first block).
+ */
+static GLvoid
+glmFreeArena(GLMarena* arena)
+{
+    GLMlarge* large;
+    GLMblock* block;
+    GLMblock* next;
+    
+    for (large = arena->large; large; large = large->next)
+        free(large->data);
+    for (block = arena->blocks; block; block = next) {
+        next = block->next;
+        free(block);
+    }
+}
+
+/* glmArenaSize: returns the bytes of memory an arena holds */
+static size_t
+glmArenaSize(GLMarena* arena)
+{
+    GLMlarge* large;
+    GLMblock* block;
+    size_t    size = 0;
+    
+    for (large = arena->large; large; large = large->next)
+        size += large->size;
+    for (block = arena->blocks; block; block = block->next)
+        size += GLM_ALIGN(sizeof(GLMblock)) + block->size;
+    
+    return size;
+}
+
+/* glmArenaCut: cuts size bytes (less than GLM_ARENA_LARGE) from the
+ * blocks of an arena.
+ */
+static GLvoid*
+glmArenaCut(GLMarena* arena, size_t size)
+{
+    GLMblock* block = arena->blocks;
+    GLvoid*   p;
+    
+    size = GLM_ALIGN(size);
+    if (block->used + size > block->size)
+        block = arena->blocks = glmNewBlock(block, GLM_ARENA_BLOCK);
+    p = (char*)block + GLM_ALIGN(sizeof(GLMblock)) + block->used;
+    block->used += size;
+    
+    return p;
+}
+
+/* glmLargeLink: returns the link to the entry of a large array of an
+ * arena, or NULL if p isn't one.
+ */
+static GLMlarge**
+glmLargeLink(GLMarena* arena, GLvoid* p)
+{
+    GLMlarge** link;
+    
+    for (link = &arena->large; *link; link = &(*link)->next)
+        if ((*link)->data == p)
+            return link;
+    
+    return NULL;
+}
+
+/* glmAdopt: hands a malloc'd array over to an arena (to be freed with
+ * it or with glmFree()).
+ *
+ * arena - arena that takes the memory
+ * p     - memory to take (may be NULL)
+ * size  - bytes allocated
+ */
+static GLvoid
+glmAdopt(GLMarena* arena, GLvoid* p, size_t size)
+{
+    GLMlarge* large;
+    
+    if (!p)
+        return;
+    
+    if (arena->spare) {
+        large = arena->spare;
+        arena->spare = large->next;
+    } else {
+        large = (GLMlarge*)glmArenaCut(arena, sizeof(GLMlarge));
+    }
+    large->data = p;
+    large->size = size;
+    large->next = arena->large;
+    arena->large = large;
+}
+
+/* glmAlloc: allocates memory for an array or string in an arena, which
+ * goes away with it.
+ *
+ * arena - arena that owns the memory
+ * size  - bytes to allocate
+ */
+static GLvoid*
+glmAlloc(GLMarena* arena, size_t size)
+{
+    GLvoid* p;
+    
+    if (size < GLM_ARENA_LARGE)
+        return glmArenaCut(arena, size);
+    
+    p = malloc(size);
+    if (!p) {
+        fprintf(stderr, "glmAlloc() failed: out of memory.\n");
+        exit(1);
+    }
+    glmAdopt(arena, p, size);
+    
+    return p;
+}
+
+/* glmStrdup: copies a string into an arena */
+static char*
+glmStrdup(GLMarena* arena, const char* s)
+{
+    return strcpy((char*)glmAlloc(arena, strlen(s) + 1), s);
+}
+
+/* glmRealloc: resizes an array in an arena (see glmAlloc()).
+ *
+ * arena   - arena that owns the memory
+ * p       - memory to resize (may be NULL)
+ * oldsize - bytes of it to keep
+ * size    - bytes it needs
+ */
+static GLvoid*
+glmRealloc(GLMarena* arena, GLvoid* p, size_t oldsize, size_t size)
+{
+    GLMlarge** link;
+    GLvoid*    q;
+    
+    link = p ? glmLargeLink(arena, p) : NULL;
+    if (link) {
+        q = realloc(p, size);
+        if (!q) {
+            fprintf(stderr, "glmRealloc() failed: out of memory.\n");
+            exit(1);
+        }
+        (*link)->data = q;
+        (*link)->size = size;
+        return q;
+    }
+    
+    /* small (or mapped) memory isn't given back until the model goes */
+    q = glmAlloc(arena, size);
+    if (p)
+        memcpy(q, p, oldsize < size ? oldsize : size);
+    
+    return q;
+}
+
+/* glmFree: frees an array or string of the model, if it is large
+ * enough to have an allocation of its own.  The rest is freed along
+ * with the model, as is anything in the memory mapped cache file the
+ * model was read from.
+ *
+ * model - model that owns the memory
+ * p     - memory to free (may be NULL)
+ */
+static GLvoid
+glmFree(GLMmodel* model, GLvoid* p)
+{
+    GLMarena*  arena = model->arena;
+    GLMlarge** link;
+    GLMlarge*  large;
+    
+    if (!p)
+        return;
+    if (model->mapping && (char*)p >= (char*)model->mapping &&
+        (char*)p < (char*)model->mapping + model->mappingsize)
+        return;
+    
+    link = glmLargeLink(arena, p);
+    if (link) {
+        large = *link;
+        *link = large->next;
+        free(large->data);
+        large->next = arena->spare;
+        arena->spare = large;
+    }
+}
+
+/* glmNewModel: allocates a model (the fields are for the caller to
+ * fill in) in an arena of its own.
+ */
+static GLMmodel*
+glmNewModel(GLvoid)
+{
+    GLMarena* arena;
+    GLMmodel* model;
+    
+    arena = glmNewArena();
+    model = (GLMmodel*)glmArenaCut(arena, sizeof(GLMmodel));
+    model->arena = arena;
+    
+    return model;
+}
+
+/* GLMsmoothing: what glmSmoothingAngle() keeps between calls.  The
+ * triangles each vertex is in are listed as in GLMsmooth, along with
+ * the dot product of each one's facet normal with that of the first
+ * one (which decides whether it is averaged).  Each vertex has its
+ * own normals: its average normal at normals[start[i] + i], then one
+ * for each of its triangles, so a vertex can change without moving
+ * any of the others.
+ */
+typedef struct _GLMsmoothing {
+    GLfloat   cos_angle;        /* cosine of the current smoothing angle */
+    GLuint*   start;            /* where each vertex's triangles start */
+    GLuint*   triangles;        /* triangles each vertex is in */
+    GLubyte*  corners;          /* which corner of them the vertex is */
+    GLfloat*  dots;             /* dot product with the first one */
+    GLuint*   sorted;           /* all of them, in order of dots */
+    GLuint*   mark;             /* last update each vertex was in */
+    GLuint    update;           /* number of the current update */
+    GLuint*   vertices;         /* vertices to update */
+    GLuint    numvertices;      /* number of vertices to update */
+    GLMmodel* model;
+} GLMsmoothing;
+
+/* glmFreeSmoothing: drops what glmSmoothingAngle() kept, once the
+ * triangles or normals of a model have changed under it.
+ */
+static GLvoid
+glmFreeSmoothing(GLMmodel* model)
+{
+    GLMsmoothing* smoothing = model->smoothing;
+    
+    if (!smoothing)
+        return;
+    
+    free(smoothing->start);
+    free(smoothing->triangles);
+    free(smoothing->corners);
+    free(smoothing->dots);
+    free(smoothing->sorted);
+    free(smoothing->mark);
+    free(smoothing->vertices);
+    free(smoothing);
+    model->smoothing = NULL;
+}
+
+
 /* glmDot: compute the dot product of two vectors
  *
  * u - array of 3 GLfloats (GLfloat u[3])
@@ -114,65 +478,148 @@ glmEqual(GLfloat* u, GLfloat* v, GLfloat epsilon)
     return GL_FALSE;
 }
 
-/* glmWeldVectors: eliminate (weld) vectors that are within an
- * epsilon of each other.
- *
- * vectors     - array of GLfloat[3]'s to be welded
- * numvectors - number of GLfloat[3]'s in vectors
- * epsilon     - maximum difference between vectors 
+/* GLMkey: returns the name of entry i of a hash table */
+typedef const char* (*GLMkey)(GLMmodel* model, GLuint i);
+
+/* glmHashString: FNV-1a hash of a string */
+static GLuint
+glmHashString(const char* name)
+{
+    GLuint hash = 2166136261u;
+    
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+/* glmHashSlot: Find the slot of a name in a hash table (open
+ * addressing, linear probing).  Slots hold entry + 1, so the returned
+ * slot is either the one of the entry with that name or an empty one
+ * where it would go.
  *
+ * table - hash table (size is a power of two)
+ * size  - number of slots in table
+ * model - model the entries are in
+ * key   - returns the name of an entry
+ * name  - name to look for
  */
-GLfloat*
-glmWeldVectors(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon)
+static GLuint*
+glmHashSlot(GLuint* table, GLuint size, GLMmodel* model, GLMkey key,
+            const char* name)
 {
-    GLfloat* copies;
-    GLuint   copied;
-    GLuint   i, j;
+    GLuint i;
     
-    copies = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (*numvectors + 1));
-    memcpy(copies, vectors, (sizeof(GLfloat) * 3 * (*numvectors + 1)));
+    i = glmHashString(name) & (size - 1);
+    while (table[i] && strcmp(key(model, table[i] - 1), name))
+        i = (i + 1) & (size - 1);
     
-    copied = 1;
-    for (i = 1; i <= *numvectors; i++) {
-        for (j = 1; j <= copied; j++) {
-            if (glmEqual(&vectors[3 * i], &copies[3 * j], epsilon)) {
-                goto duplicate;
-            }
-        }
-        
-        /* must not be any duplicates -- add to the copies array */
-        copies[3 * copied + 0] = vectors[3 * i + 0];
-        copies[3 * copied + 1] = vectors[3 * i + 1];
-        copies[3 * copied + 2] = vectors[3 * i + 2];
-        j = copied;             /* pass this along for below */
-        copied++;
-        
-duplicate:
-/* set the first component of this vector to point at the correct
-        index into the new copies array */
-        vectors[3 * i + 0] = (GLfloat)j;
+    return &table[i];
+}
+
+/* glmHashSize: number of slots for a hash table of count entries,
+ * leaving it at most a quarter full.
+ */
+static GLuint
+glmHashSize(GLuint count)
+{
+    GLuint size;
+    
+    size = 16;
+    while (size < 4 * count)
+        size *= 2;
+    
+    return size;
+}
+
+/* glmHashTable: Build a hash table of the first count entries of a
+ * model, with room for at least as many more (see glmHashSize()).  The first of several
+ * entries with the same name is the one that is found.
+ *
+ * model - model the entries are in
+ * key   - returns the name of an entry
+ * count - number of entries
+ * size  - will contain the number of slots in the table
+ */
+static GLuint*
+glmHashTable(GLMmodel* model, GLMkey key, GLuint count, GLuint* size)
+{
+    GLuint* table;
+    GLuint* slot;
+    GLuint  i;
+    
+    *size = glmHashSize(count);
+    table = (GLuint*)glmAlloc(model->arena, sizeof(GLuint) * (*size));
+    memset(table, 0, sizeof(GLuint) * (*size));
+    for (i = 0; i < count; i++) {
+        slot = glmHashSlot(table, *size, model, key, key(model, i));
+        if (!*slot)
+            *slot = i + 1;
     }
     
-    *numvectors = copied-1;
-    return copies;
+    return table;
+}
+
+static const char*
+glmGroupKey(GLMmodel* model, GLuint i)
+{
+    return model->grouparray[i]->name;
+}
+
+static const char*
+glmMaterialKey(GLMmodel* model, GLuint i)
+{
+    return model->materials[i].name;
+}
+
+/* glmIndexGroups: (Re)build the ordered group array and the hash table
+ * of group names from the linked list of groups (which runs from the
+ * last group added to the first).
+ */
+static GLvoid
+glmIndexGroups(GLMmodel* model)
+{
+    GLMgroup* group;
+    GLuint i;
+    
+    glmFree(model, model->grouparray);
+    glmFree(model, model->grouphash);
+    
+    model->grouparray = (GLMgroup**)glmAlloc(model->arena, sizeof(GLMgroup*) * 
+        glmHashSize(model->numgroups) / 4);
+    i = model->numgroups;
+    for (group = model->groups; group && i; group = group->next)
+        model->grouparray[--i] = group;
+    model->grouphash = glmHashTable(model, glmGroupKey, model->numgroups,
+        &model->grouphashsize);
+}
+
+/* glmIndexMaterials: (Re)build the hash table of material names */
+static GLvoid
+glmIndexMaterials(GLMmodel* model)
+{
+    glmFree(model, model->materialhash);
+    model->materialhash = glmHashTable(model, glmMaterialKey, 
+        model->nummaterials, &model->materialhashsize);
 }
 
 /* glmFindGroup: Find a group in the model */
 GLMgroup*
 glmFindGroup(GLMmodel* model, char* name)
 {
-    GLMgroup* group;
+    GLuint* slot;
     
     assert(model);
     
-    group = model->groups;
-    while(group) {
-        if (!strcmp(name, group->name))
-            break;
-        group = group->next;
-    }
+    if (!model->grouphash)
+        glmIndexGroups(model);
     
-    return group;
+    slot = glmHashSlot(model->grouphash, model->grouphashsize, model,
+        glmGroupKey, name);
+    
+    return *slot ? model->grouparray[*slot - 1] : NULL;
 }
 
 /* glmAddGroup: Add a group to the model */
@@ -180,42 +627,58 @@ GLMgroup*
 glmAddGroup(GLMmodel* model, char* name)
 {
     GLMgroup* group;
+    GLuint*   slot;
     
     group = glmFindGroup(model, name);
     if (!group) {
-        group = (GLMgroup*)malloc(sizeof(GLMgroup));
-        group->name = strdup(name);
+        group = (GLMgroup*)glmAlloc(model->arena, sizeof(GLMgroup));
+        group->name = glmStrdup(model->arena, name);
         group->material = 0;
         group->numtriangles = 0;
         group->triangles = NULL;
         group->next = model->groups;
         model->groups = group;
         model->numgroups++;
+        
+        /* the array and the table grow together, the array holding a
+           quarter as many groups as there are slots in the table */
+        if (4 * model->numgroups > model->grouphashsize) {
+            model->grouparray = (GLMgroup**)glmRealloc(model->arena, 
+                model->grouparray, sizeof(GLMgroup*) * (model->numgroups - 1),
+                sizeof(GLMgroup*) * glmHashSize(model->numgroups) / 4);
+            model->grouparray[model->numgroups - 1] = group;
+            glmFree(model, model->grouphash);
+            model->grouphash = glmHashTable(model, glmGroupKey, 
+                model->numgroups, &model->grouphashsize);
+        } else {
+            model->grouparray[model->numgroups - 1] = group;
+            slot = glmHashSlot(model->grouphash, model->grouphashsize, 
+                model, glmGroupKey, name);
+            *slot = model->numgroups;
+        }
     }
     
     return group;
 }
 
-/* glmFindGroup: Find a material in the model */
+/* glmFindMaterial: Find a material in the model */
 GLuint
 glmFindMaterial(GLMmodel* model, char* name)
 {
-    GLuint i;
+    GLuint* slot;
     
-    /* XXX doing a linear search on a string key'd list is pretty lame,
-    but it works and is fast enough for now. */
-    for (i = 0; i < model->nummaterials; i++) {
-        if (!strcmp(model->materials[i].name, name))
-            goto found;
-    }
+    if (!model->materialhash)
+        glmIndexMaterials(model);
+    
+    slot = glmHashSlot(model->materialhash, model->materialhashsize, 
+        model, glmMaterialKey, name);
+    if (*slot)
+        return *slot - 1;
     
     /* didn't find the name, so print a warning and return the default
     material (0). */
     printf("glmFindMaterial():  can't find material \"%s\".\n", name);
-    i = 0;
-    
-found:
-    return i;
+    return 0;
 }
 
 
@@ -243,154 +706,507 @@ glmDirName(char* path)
 }
 
 
-/* glmReadMTL: read a wavefront material library file
+/* GLMscanner: cursor into the in-memory image of a Wavefront file */
+typedef struct _GLMscanner {
+    const char* p;              /* current position */
+    const char* end;            /* one past the last character */
+} GLMscanner;
+
+/* glmGrow: makes room for at least count elements of size bytes in a
+ * malloc'd array, doubling its capacity as needed.  Returns the
+ * (possibly moved) array.
  *
- * model - properly initialized GLMmodel structure
- * name  - name of the material library
+ * array    - array to grow (may be NULL)
+ * capacity - number of elements the array currently holds
+ * count    - number of elements required
+ * size     - size of one element in bytes
  */
-static GLvoid
-glmReadMTL(GLMmodel* model, char* name)
+static GLvoid*
+glmGrow(GLvoid* array, GLuint* capacity, GLuint count, size_t size)
 {
-    FILE* file;
-    char* dir;
-    char* filename;
-    char    buf[128];
-    GLuint nummaterials, i;
+    if (count <= *capacity)
+        return array;
     
-    dir = glmDirName(model->pathname);
-    filename = (char*)malloc(sizeof(char) * (strlen(dir) + strlen(name) + 1));
-    strcpy(filename, dir);
-    strcat(filename, name);
-    free(dir);
+    if (*capacity < 64)
+        *capacity = 64;
+    while (*capacity < count)
+        *capacity *= 2;
     
-    file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "glmReadMTL() failed: can't open material file \"%s\".\n",
-            filename);
+    array = realloc(array, size * (*capacity));
+    if (!array) {
+        fprintf(stderr, "glmGrow() failed: out of memory.\n");
         exit(1);
     }
-    free(filename);
-    
-    /* count the number of materials in the file */
-    nummaterials = 1;
-    while(fscanf(file, "%s", buf) != EOF) {
-        switch(buf[0]) {
-        case '#':               /* comment */
-            /* eat up rest of line */
-            fgets(buf, sizeof(buf), file);
-            break;
-        case 'n':               /* newmtl */
-            fgets(buf, sizeof(buf), file);
-            nummaterials++;
-            sscanf(buf, "%s %s", buf, buf);
-            break;
-        default:
-            /* eat up rest of line */
-            fgets(buf, sizeof(buf), file);
-            break;
-        }
-    }
+    return array;
+}
+
+/* glmArenaGrow: glmGrow() for an array in an arena (see glmAlloc()) */
+static GLvoid*
+glmArenaGrow(GLMarena* arena, GLvoid* array, GLuint* capacity, GLuint count,
+             size_t size)
+{
+    GLuint old = *capacity;
     
-    rewind(file);
+    if (count <= *capacity)
+        return array;
     
-    model->materials = (GLMmaterial*)malloc(sizeof(GLMmaterial) * nummaterials);
-    model->nummaterials = nummaterials;
+    if (*capacity < 64)
+        *capacity = 64;
+    while (*capacity < count)
+        *capacity *= 2;
     
-    /* set the default material */
-    for (i = 0; i < nummaterials; i++) {
-        model->materials[i].name = NULL;
-        model->materials[i].shininess = 65.0;
-        model->materials[i].diffuse[0] = 0.8;
-        model->materials[i].diffuse[1] = 0.8;
-        model->materials[i].diffuse[2] = 0.8;
-        model->materials[i].diffuse[3] = 1.0;
-        model->materials[i].ambient[0] = 0.2;
-        model->materials[i].ambient[1] = 0.2;
-        model->materials[i].ambient[2] = 0.2;
-        model->materials[i].ambient[3] = 1.0;
-        model->materials[i].specular[0] = 0.0;
-        model->materials[i].specular[1] = 0.0;
-        model->materials[i].specular[2] = 0.0;
-        model->materials[i].specular[3] = 1.0;
-    }
-    model->materials[0].name = strdup("default");
-    
-    /* now, read in the data */
-    nummaterials = 0;
-    while(fscanf(file, "%s", buf) != EOF) {
-        switch(buf[0]) {
-        case '#':               /* comment */
-            /* eat up rest of line */
-            fgets(buf, sizeof(buf), file);
-            break;
-        case 'n':               /* newmtl */
-            fgets(buf, sizeof(buf), file);
-            sscanf(buf, "%s %s", buf, buf);
-            nummaterials++;
-            model->materials[nummaterials].name = strdup(buf);
-            break;
-        case 'N':
-            fscanf(file, "%f", &model->materials[nummaterials].shininess);
-            /* wavefront shininess is from [0, 1000], so scale for OpenGL */
-            model->materials[nummaterials].shininess /= 1000.0;
-            model->materials[nummaterials].shininess *= 128.0;
-            break;
-        case 'K':
-            switch(buf[1]) {
-            case 'd':
-                fscanf(file, "%f %f %f",
-                    &model->materials[nummaterials].diffuse[0],
-                    &model->materials[nummaterials].diffuse[1],
-                    &model->materials[nummaterials].diffuse[2]);
-                break;
-            case 's':
-                fscanf(file, "%f %f %f",
-                    &model->materials[nummaterials].specular[0],
-                    &model->materials[nummaterials].specular[1],
-                    &model->materials[nummaterials].specular[2]);
-                break;
-            case 'a':
-                fscanf(file, "%f %f %f",
-                    &model->materials[nummaterials].ambient[0],
-                    &model->materials[nummaterials].ambient[1],
-                    &model->materials[nummaterials].ambient[2]);
-                break;
-            default:
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                break;
-            }
-            break;
-            default:
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                break;
-        }
-    }
+    return glmRealloc(arena, array, size * old, size * (*capacity));
+}
 
-    fclose(file);
+/* glmScanBlank: skips spaces and tabs, but not the end of the line */
+static GLvoid
+glmScanBlank(GLMscanner* s)
+{
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\r'))
+        s->p++;
 }
 
-/* glmWriteMTL: write a wavefront material library file
- *
- * model   - properly initialized GLMmodel structure
- * modelpath  - pathname of the model being written
- * mtllibname - name of the material library to be written
- */
+/* glmScanLine: skips to the first character of the next line */
 static GLvoid
-glmWriteMTL(GLMmodel* model, char* modelpath, char* mtllibname)
+glmScanLine(GLMscanner* s)
 {
-    FILE* file;
-    char* dir;
-    char* filename;
-    GLMmaterial* material;
-    GLuint i;
+    const char* eol;
     
-    dir = glmDirName(modelpath);
-    filename = (char*)malloc(sizeof(char) * (strlen(dir)+strlen(mtllibname)));
-    strcpy(filename, dir);
-    strcat(filename, mtllibname);
-    free(dir);
+    eol = (const char*)memchr(s->p, '\n', (size_t)(s->end - s->p));
+    s->p = eol ? eol + 1 : s->end;
+}
+
+/* glmScanToken: returns the next whitespace delimited token on the
+ * current line (or NULL at the end of the line) and its length.
+ */
+static const char*
+glmScanToken(GLMscanner* s, size_t* length)
+{
+    const char* token;
+    
+    glmScanBlank(s);
+    token = s->p;
+    while (s->p < s->end && !isspace((unsigned char)*s->p))
+        s->p++;
+    *length = s->p - token;
+    
+    return *length ? token : NULL;
+}
+
+/* powers of ten that are exact in a float/double */
+static const GLfloat glm_pow10f[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+static const double glm_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* glmParseFloat: decodes the decimal number at the current position
+ * (as written by printf's %f, %e or %g) into the correctly rounded
+ * float, without going through the locale dependent strtof.  Numbers
+ * whose digits fit in a 64-bit integer and whose power of ten is
+ * exact in a float (or double) are rounded by a single division or
+ * multiplication.  Returns GL_FALSE, leaving the position alone, for
+ * anything else, which the caller hands to strtof instead.
+ */
+static GLboolean
+glmParseFloat(GLMscanner* s, GLfloat* f)
+{
+    const char* p;
+    unsigned long long m, bits;
+    GLboolean negative, truncated, any;
+    int digits, e, exponent, expsign;
+    double d;
+    GLfloat x;
+    
+    p = s->p;
+    negative = truncated = any = GL_FALSE;
+    m = 0;
+    digits = e = 0;
+    
+    if (p < s->end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    
+    /* mantissa: up to 19 significant digits go into m, the value is
+       m * 10^e */
+    for (; p < s->end && *p >= '0' && *p <= '9'; p++) {
+        any = GL_TRUE;
+        if (digits < 19) {
+            m = m * 10 + (*p - '0');
+            if (m)
+                digits++;
+        } else {
+            e++;
+            truncated |= *p != '0';
+        }
+    }
+    if (p < s->end && *p == '.') {
+        for (p++; p < s->end && *p >= '0' && *p <= '9'; p++) {
+            any = GL_TRUE;
+            if (digits < 19) {
+                m = m * 10 + (*p - '0');
+                if (m)
+                    digits++;
+                e--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+    }
+    if (!any)
+        return GL_FALSE;
+    
+    if (p + 1 < s->end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        
+        expsign = 1;
+        if (*q == '-' || *q == '+')
+            expsign = (*q++ == '-') ? -1 : 1;
+        if (q < s->end && *q >= '0' && *q <= '9') {
+            for (exponent = 0; q < s->end && *q >= '0' && *q <= '9'; q++) {
+                if (exponent < 10000)
+                    exponent = exponent * 10 + (*q - '0');
+            }
+            e += expsign * exponent;
+            p = q;
+        }
+    }
+    
+    /* the number has to be the whole token */
+    if (truncated || (p < s->end && !isspace((unsigned char)*p)))
+        return GL_FALSE;
+    
+    if (m == 0) {
+        x = 0.0;
+    } else if (m <= (1 << 24) && e >= -10 && e <= 10) {
+        /* both operands are exact, so one rounding is all there is */
+        x = (GLfloat)m;
+        x = e < 0 ? x / glm_pow10f[-e] : x * glm_pow10f[e];
+    } else if (m <= (1ULL << 53) && e >= -22 && e <= 22) {
+        d = (double)m;
+        d = e < 0 ? d / glm_pow10[-e] : d * glm_pow10[e];
+        
+        /* rounding the double to a float rounds twice, which only goes
+           wrong right at (or, with x87 extended precision, next to) a
+           halfway point between two floats; leave those, denormals
+           and overflows to strtof */
+        if (d < 1.17549435e-38 || d > 3.40282347e+38)
+            return GL_FALSE;
+        memcpy(&bits, &d, sizeof(bits));
+        bits &= (1 << 29) - 1;
+        if (bits >= (1 << 28) - 1 && bits <= (1 << 28) + 1)
+            return GL_FALSE;
+        x = (GLfloat)d;
+    } else {
+        return GL_FALSE;
+    }
+    
+    *f = negative ? -x : x;
+    s->p = p;
+    return GL_TRUE;
+}
+
+/* glmScanFloat: reads the next token on the current line as a float.
+ * Returns GL_FALSE if there is no such token.
+ */
+static GLboolean
+glmScanFloat(GLMscanner* s, GLfloat* f)
+{
+    const char* token;
+    size_t length;
+    char buf[64];
+    
+    glmScanBlank(s);
+    if (glmParseFloat(s, f))
+        return GL_TRUE;
+    
+    token = glmScanToken(s, &length);
+    if (!token)
+        return GL_FALSE;
+    if (length >= sizeof(buf))
+        length = sizeof(buf) - 1;
+    memcpy(buf, token, length);
+    buf[length] = '\0';
+    *f = strtof(buf, NULL);
+    
+    return GL_TRUE;
+}
+
+/* glmScanInt: reads an (optionally signed) integer at the current
+ * position.  Returns GL_FALSE if there are no digits here.
+ */
+static GLboolean
+glmScanInt(GLMscanner* s, GLint* i)
+{
+    const char* p;
+    GLboolean negative;
+    GLint value;
+    
+    p = s->p;
+    negative = GL_FALSE;
+    if (p < s->end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    if (p == s->end || *p < '0' || *p > '9')
+        return GL_FALSE;
+    
+    value = 0;
+    while (p < s->end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    
+    *i = negative ? -value : value;
+    s->p = p;
+    return GL_TRUE;
+}
+
+/* glmScanCorner: reads the next face corner on the current line in any
+ * of the forms v, v/t, v//n or v/t/n.  Missing indices are returned
+ * as 0.  Returns GL_FALSE if there is no corner left on the line.
+ */
+static GLboolean
+glmScanCorner(GLMscanner* s, GLint* v, GLint* t, GLint* n)
+{
+    glmScanBlank(s);
+    *v = *t = *n = 0;
+    if (!glmScanInt(s, v))
+        return GL_FALSE;
+    if (s->p < s->end && *s->p == '/') {
+        s->p++;
+        glmScanInt(s, t);
+        if (s->p < s->end && *s->p == '/') {
+            s->p++;
+            glmScanInt(s, n);
+        }
+    }
+    /* skip whatever is left of a malformed corner */
+    while (s->p < s->end && !isspace((unsigned char)*s->p))
+        s->p++;
+    
+    return GL_TRUE;
+}
+
+/* glmScanName: returns the first word on the rest of the line as a
+ * NUL terminated string in buf (truncated to fit).
+ */
+static char*
+glmScanName(GLMscanner* s, char* buf, size_t size)
+{
+    const char* token;
+    size_t length;
+    
+    token = glmScanToken(s, &length);
+    if (!token)
+        length = 0;
+    if (length >= size)
+        length = size - 1;
+    memcpy(buf, token, length);
+    buf[length] = '\0';
+    
+    return buf;
+}
+
+/* glmScanRest: returns the rest of the line, without surrounding
+ * whitespace, as a NUL terminated string in buf (truncated to fit).
+ */
+static char*
+glmScanRest(GLMscanner* s, char* buf, size_t size)
+{
+    const char* begin;
+    const char* end;
+    size_t length;
+    
+    glmScanBlank(s);
+    begin = end = s->p;
+    while (end < s->end && *end != '\n')
+        end++;
+    s->p = end;
+    while (end > begin && isspace((unsigned char)end[-1]))
+        end--;
+    
+    length = end - begin;
+    if (length >= size)
+        length = size - 1;
+    memcpy(buf, begin, length);
+    buf[length] = '\0';
+    
+    return buf;
+}
+
+/* glmMapFile: maps a whole file into memory, read only.  Returns
+ * MAP_FAILED if the file can't be opened or mapped, and NULL if it is
+ * empty.  Release it with glmUnmapFile().
+ *
+ * filename - name of the file
+ * size     - will contain the size of the file in bytes on return
+ */
+static char*
+glmMapFile(char* filename, size_t* size)
+{
+    struct stat info;
+    char* data;
+    int fd;
+    
+    fd = open(filename, O_RDONLY | O_BINARY);
+    if (fd < 0)
+        return (char*)MAP_FAILED;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return (char*)MAP_FAILED;
+    }
+    
+    *size = info.st_size;
+    data = NULL;
+    if (*size > 0)
+        data = (char*)mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    
+    /* the mapping stays valid after the file is closed */
+    close(fd);
+    
+    return data;
+}
+
+/* glmUnmapFile: releases a file mapped with glmMapFile() */
+static GLvoid
+glmUnmapFile(char* data, size_t size)
+{
+    if (data && data != (char*)MAP_FAILED)
+        munmap(data, size);
+}
+
+/* glmIsToken: tells whether a scanned token is the given keyword */
+static GLboolean
+glmIsToken(const char* token, size_t length, const char* keyword)
+{
+    return strlen(keyword) == length && !memcmp(token, keyword, length);
+}
+
+/* glmDefaultMaterial: sets a material to the OpenGL defaults */
+static GLvoid
+glmDefaultMaterial(GLMmaterial* material)
+{
+    material->name = NULL;
+    material->shininess = 65.0;
+    material->diffuse[0] = 0.8;
+    material->diffuse[1] = 0.8;
+    material->diffuse[2] = 0.8;
+    material->diffuse[3] = 1.0;
+    material->ambient[0] = 0.2;
+    material->ambient[1] = 0.2;
+    material->ambient[2] = 0.2;
+    material->ambient[3] = 1.0;
+    material->specular[0] = 0.0;
+    material->specular[1] = 0.0;
+    material->specular[2] = 0.0;
+    material->specular[3] = 1.0;
+    material->emmissive[0] = 0.0;
+    material->emmissive[1] = 0.0;
+    material->emmissive[2] = 0.0;
+    material->emmissive[3] = 1.0;
+}
+
+/* glmReadMTL: read a wavefront material library file in a single pass
+ *
+ * model - properly initialized GLMmodel structure
+ * name  - name of the material library
+ */
+static GLvoid
+glmReadMTL(GLMmodel* model, char* name)
+{
+    GLMscanner s;
+    GLMmaterial* material;
+    char*   dir;
+    char*   filename;
+    char*   data;
+    size_t  size, length;
+    const char* token;
+    GLuint  nummaterials, maxmaterials;
+    char    buf[128];
+    
+    dir = glmDirName(model->pathname);
+    filename = (char*)malloc(sizeof(char) * (strlen(dir) + strlen(name) + 1));
+    strcpy(filename, dir);
+    strcat(filename, name);
+    free(dir);
+    
+    data = glmMapFile(filename, &size);
+    if (data == (char*)MAP_FAILED) {
+        fprintf(stderr, "glmReadMTL() failed: can't open material file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    free(filename);
+    
+    /* material 0 is the default one */
+    maxmaterials = 0;
+    model->materials = (GLMmaterial*)glmArenaGrow(model->arena, NULL, &maxmaterials,
+        1, sizeof(GLMmaterial));
+    nummaterials = 1;
+    material = &model->materials[0];
+    glmDefaultMaterial(material);
+    material->name = glmStrdup(model->arena, "default");
+    
+    s.p = data;
+    s.end = data + size;
+    while (s.p < s.end) {
+        token = glmScanToken(&s, &length);
+        if (!token) {
+            /* blank line */
+        } else if (glmIsToken(token, length, "newmtl")) {
+            model->materials = (GLMmaterial*)glmArenaGrow(model->arena, 
+                model->materials, &maxmaterials, nummaterials + 1, 
+                sizeof(GLMmaterial));
+            material = &model->materials[nummaterials++];
+            glmDefaultMaterial(material);
+            material->name = glmStrdup(model->arena, 
+                glmScanName(&s, buf, sizeof(buf)));
+        } else if (glmIsToken(token, length, "Ns")) {
+            glmScanFloat(&s, &material->shininess);
+            /* wavefront shininess is from [0, 1000], so scale for OpenGL */
+            material->shininess /= 1000.0;
+            material->shininess *= 128.0;
+        } else if (glmIsToken(token, length, "Kd")) {
+            glmScanFloat(&s, &material->diffuse[0]);
+            glmScanFloat(&s, &material->diffuse[1]);
+            glmScanFloat(&s, &material->diffuse[2]);
+        } else if (glmIsToken(token, length, "Ks")) {
+            glmScanFloat(&s, &material->specular[0]);
+            glmScanFloat(&s, &material->specular[1]);
+            glmScanFloat(&s, &material->specular[2]);
+        } else if (glmIsToken(token, length, "Ka")) {
+            glmScanFloat(&s, &material->ambient[0]);
+            glmScanFloat(&s, &material->ambient[1]);
+            glmScanFloat(&s, &material->ambient[2]);
+        }
+        
+        /* eat up rest of line */
+        glmScanLine(&s);
+    }
+    model->nummaterials = nummaterials;
+    glmIndexMaterials(model);
+    
+    glmUnmapFile(data, size);
+}
+
+/* glmWriteMTL: write a wavefront material library file
+ *
+ * model   - properly initialized GLMmodel structure
+ * modelpath  - pathname of the model being written
+ * mtllibname - name of the material library to be written
+ */
+static GLvoid
+glmWriteMTL(GLMmodel* model, char* modelpath, char* mtllibname)
+{
+    FILE* file;
+    char* dir;
+    char* filename;
+    GLMmaterial* material;
+    GLuint i;
+    
+    dir = glmDirName(modelpath);
+    filename = (char*)malloc(sizeof(char) * (strlen(dir)+strlen(mtllibname)));
+    strcpy(filename, dir);
+    strcat(filename, mtllibname);
+    free(dir);
     
     /* open the file */
     file = fopen(filename, "w");
@@ -426,365 +1242,927 @@ glmWriteMTL(GLMmodel* model, char* modelpath, char* mtllibname)
 }
 
 
-/* glmFirstPass: first pass at a Wavefront OBJ file that gets all the
- * statistics of the model (such as #vertices, #normals, etc)
- *
- * model - properly initialized GLMmodel structure
- * file  - (fopen'd) file descriptor 
- */
-static GLvoid
-glmFirstPass(GLMmodel* model, FILE* file) 
+/* glmProcessors: returns the number of processors in the machine */
+static GLuint
+glmProcessors(void)
 {
-    GLuint  numvertices;        /* number of vertices in model */
-    GLuint  numnormals;         /* number of normals in model */
-    GLuint  numtexcoords;       /* number of texcoords in model */
-    GLuint  numtriangles;       /* number of triangles in model */
-    GLMgroup* group;            /* current group */
-    unsigned    v, n, t;
-    char        buf[128];
-    
-    /* make a default group */
-    group = glmAddGroup(model, "default");
+#ifdef _WIN32
+    SYSTEM_INFO info;
     
-    numvertices = numnormals = numtexcoords = numtriangles = 0;
-    while(fscanf(file, "%s", buf) != EOF) {
-        switch(buf[0]) {
-        case '#':               /* comment */
-            /* eat up rest of line */
-            fgets(buf, sizeof(buf), file);
-            break;
-        case 'v':               /* v, vn, vt */
-            switch(buf[1]) {
-            case '\0':          /* vertex */
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                numvertices++;
-                break;
-            case 'n':           /* normal */
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                numnormals++;
-                break;
-            case 't':           /* texcoord */
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                numtexcoords++;
-                break;
-            default:
-                printf("glmFirstPass(): Unknown token \"%s\".\n", buf);
-                exit(1);
-                break;
-            }
-            break;
-            case 'm':
-                fgets(buf, sizeof(buf), file);
-                sscanf(buf, "%s %s", buf, buf);
-                model->mtllibname = strdup(buf);
-                glmReadMTL(model, buf);
-                break;
-            case 'u':
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                break;
-            case 'g':               /* group */
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-#if SINGLE_STRING_GROUP_NAMES
-                sscanf(buf, "%s", buf);
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
 #else
-                buf[strlen(buf)-1] = '\0';  /* nuke '\n' */
+    long n;
+    
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (GLuint)n : 1;
 #endif
-                group = glmAddGroup(model, buf);
-                break;
-            case 'f':               /* face */
-                v = n = t = 0;
-                fscanf(file, "%s", buf);
-                /* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-                if (strstr(buf, "//")) {
-                    /* v//n */
-                    sscanf(buf, "%d//%d", &v, &n);
-                    fscanf(file, "%d//%d", &v, &n);
-                    fscanf(file, "%d//%d", &v, &n);
-                    numtriangles++;
-                    group->numtriangles++;
-                    while(fscanf(file, "%d//%d", &v, &n) > 0) {
-                        numtriangles++;
-                        group->numtriangles++;
-                    }
-                } else if (sscanf(buf, "%d/%d/%d", &v, &t, &n) == 3) {
-                    /* v/t/n */
-                    fscanf(file, "%d/%d/%d", &v, &t, &n);
-                    fscanf(file, "%d/%d/%d", &v, &t, &n);
-                    numtriangles++;
-                    group->numtriangles++;
-                    while(fscanf(file, "%d/%d/%d", &v, &t, &n) > 0) {
-                        numtriangles++;
-                        group->numtriangles++;
-                    }
-                } else if (sscanf(buf, "%d/%d", &v, &t) == 2) {
-                    /* v/t */
-                    fscanf(file, "%d/%d", &v, &t);
-                    fscanf(file, "%d/%d", &v, &t);
-                    numtriangles++;
-                    group->numtriangles++;
-                    while(fscanf(file, "%d/%d", &v, &t) > 0) {
-                        numtriangles++;
-                        group->numtriangles++;
-                    }
-                } else {
-                    /* v */
-                    fscanf(file, "%d", &v);
-                    fscanf(file, "%d", &v);
-                    numtriangles++;
-                    group->numtriangles++;
-                    while(fscanf(file, "%d", &v) > 0) {
-                        numtriangles++;
-                        group->numtriangles++;
-                    }
-                }
-                break;
-                
-            default:
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                break;
-        }
-  }
-  
-  /* set the stats in the model structure */
-  model->numvertices  = numvertices;
-  model->numnormals   = numnormals;
-  model->numtexcoords = numtexcoords;
-  model->numtriangles = numtriangles;
-  
-  /* allocate memory for the triangles in each group */
-  group = model->groups;
-  while(group) {
-      group->triangles = (GLuint*)malloc(sizeof(GLuint) * group->numtriangles);
-      group->numtriangles = 0;
-      group = group->next;
-  }
 }
 
-/* glmSecondPass: second pass at a Wavefront OBJ file that gets all
- * the data.
+/* GLMtask: a piece of work run by glmParallel on items [begin, end) */
+typedef GLvoid (*GLMtask)(GLvoid* data, GLuint begin, GLuint end);
+
+/* _GLMwork: the share of the items one thread works on */
+typedef struct _GLMwork {
+    GLMtask  task;
+    GLvoid*  data;
+    GLuint   begin;
+    GLuint   end;
+} GLMwork;
+
+static GLvoid*
+glmWorker(GLvoid* arg)
+{
+    GLMwork* work = (GLMwork*)arg;
+    
+    work->task(work->data, work->begin, work->end);
+    return NULL;
+}
+
+/* glmParallel: splits count items into contiguous ranges and runs task
+ * on each of them on its own thread, returning when all are done.  The
+ * calling thread works on the first range itself.
  *
- * model - properly initialized GLMmodel structure
- * file  - (fopen'd) file descriptor 
+ * numthreads - number of threads to use (0 = one per processor)
+ * count      - number of items
+ * task       - function to run on each range
+ * data       - passed through to task
  */
 static GLvoid
-glmSecondPass(GLMmodel* model, FILE* file) 
-{
-    GLuint  numvertices;        /* number of vertices in model */
-    GLuint  numnormals;         /* number of normals in model */
-    GLuint  numtexcoords;       /* number of texcoords in model */
-    GLuint  numtriangles;       /* number of triangles in model */
-    GLfloat*    vertices;           /* array of vertices  */
-    GLfloat*    normals;            /* array of normals */
-    GLfloat*    texcoords;          /* array of texture coordinates */
-    GLMgroup* group;            /* current group pointer */
-    GLuint  material;           /* current material */
-    GLuint  v, n, t;
-    char        buf[128];
-    
-    /* set the pointer shortcuts */
-    vertices       = model->vertices;
-    normals    = model->normals;
-    texcoords    = model->texcoords;
-    group      = model->groups;
-    
-    /* on the second pass through the file, read all the data into the
-    allocated arrays */
-    numvertices = numnormals = numtexcoords = 1;
-    numtriangles = 0;
-    material = 0;
-    while(fscanf(file, "%s", buf) != EOF) {
-        switch(buf[0]) {
-        case '#':               /* comment */
-            /* eat up rest of line */
-            fgets(buf, sizeof(buf), file);
-            break;
-        case 'v':               /* v, vn, vt */
-            switch(buf[1]) {
-            case '\0':          /* vertex */
-                fscanf(file, "%f %f %f", 
-                    &vertices[3 * numvertices + 0], 
-                    &vertices[3 * numvertices + 1], 
-                    &vertices[3 * numvertices + 2]);
-                numvertices++;
-                break;
-            case 'n':           /* normal */
-                fscanf(file, "%f %f %f", 
-                    &normals[3 * numnormals + 0],
-                    &normals[3 * numnormals + 1], 
-                    &normals[3 * numnormals + 2]);
-                numnormals++;
-                break;
-            case 't':           /* texcoord */
-                fscanf(file, "%f %f", 
-                    &texcoords[2 * numtexcoords + 0],
-                    &texcoords[2 * numtexcoords + 1]);
-                numtexcoords++;
-                break;
-            }
-            break;
-            case 'u':
-                fgets(buf, sizeof(buf), file);
-                sscanf(buf, "%s %s", buf, buf);
-                group->material = material = glmFindMaterial(model, buf);
-                break;
-            case 'g':               /* group */
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-#if SINGLE_STRING_GROUP_NAMES
-                sscanf(buf, "%s", buf);
-#else
-                buf[strlen(buf)-1] = '\0';  /* nuke '\n' */
-#endif
-                group = glmFindGroup(model, buf);
-                group->material = material;
-                break;
-            case 'f':               /* face */
-                v = n = t = 0;
-                fscanf(file, "%s", buf);
-                /* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-                if (strstr(buf, "//")) {
-                    /* v//n */
-                    sscanf(buf, "%d//%d", &v, &n);
-                    T(numtriangles).vindices[0] = v;
-                    T(numtriangles).nindices[0] = n;
-                    fscanf(file, "%d//%d", &v, &n);
-                    T(numtriangles).vindices[1] = v;
-                    T(numtriangles).nindices[1] = n;
-                    fscanf(file, "%d//%d", &v, &n);
-                    T(numtriangles).vindices[2] = v;
-                    T(numtriangles).nindices[2] = n;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d//%d", &v, &n) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).nindices[0] = T(numtriangles-1).nindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).nindices[1] = T(numtriangles-1).nindices[2];
-                        T(numtriangles).vindices[2] = v;
-                        T(numtriangles).nindices[2] = n;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                } else if (sscanf(buf, "%d/%d/%d", &v, &t, &n) == 3) {
-                    /* v/t/n */
-                    T(numtriangles).vindices[0] = v;
-                    T(numtriangles).tindices[0] = t;
-                    T(numtriangles).nindices[0] = n;
-                    fscanf(file, "%d/%d/%d", &v, &t, &n);
-                    T(numtriangles).vindices[1] = v;
-                    T(numtriangles).tindices[1] = t;
-                    T(numtriangles).nindices[1] = n;
-                    fscanf(file, "%d/%d/%d", &v, &t, &n);
-                    T(numtriangles).vindices[2] = v;
-                    T(numtriangles).tindices[2] = t;
-                    T(numtriangles).nindices[2] = n;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d/%d/%d", &v, &t, &n) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).tindices[0] = T(numtriangles-1).tindices[0];
-                        T(numtriangles).nindices[0] = T(numtriangles-1).nindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).tindices[1] = T(numtriangles-1).tindices[2];
-                        T(numtriangles).nindices[1] = T(numtriangles-1).nindices[2];
-                        T(numtriangles).vindices[2] = v;
-                        T(numtriangles).tindices[2] = t;
-                        T(numtriangles).nindices[2] = n;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                } else if (sscanf(buf, "%d/%d", &v, &t) == 2) {
-                    /* v/t */
-                    T(numtriangles).vindices[0] = v;
-                    T(numtriangles).tindices[0] = t;
-                    fscanf(file, "%d/%d", &v, &t);
-                    T(numtriangles).vindices[1] = v;
-                    T(numtriangles).tindices[1] = t;
-                    fscanf(file, "%d/%d", &v, &t);
-                    T(numtriangles).vindices[2] = v;
-                    T(numtriangles).tindices[2] = t;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d/%d", &v, &t) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).tindices[0] = T(numtriangles-1).tindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).tindices[1] = T(numtriangles-1).tindices[2];
-                        T(numtriangles).vindices[2] = v;
-                        T(numtriangles).tindices[2] = t;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                } else {
-                    /* v */
-                    sscanf(buf, "%d", &v);
-                    T(numtriangles).vindices[0] = v;
-                    fscanf(file, "%d", &v);
-                    T(numtriangles).vindices[1] = v;
-                    fscanf(file, "%d", &v);
-                    T(numtriangles).vindices[2] = v;
-                    group->triangles[group->numtriangles++] = numtriangles;
-                    numtriangles++;
-                    while(fscanf(file, "%d", &v) > 0) {
-                        T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-                        T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-                        T(numtriangles).vindices[2] = v;
-                        group->triangles[group->numtriangles++] = numtriangles;
-                        numtriangles++;
-                    }
-                }
-                break;
-                
-            default:
-                /* eat up rest of line */
-                fgets(buf, sizeof(buf), file);
-                break;
+glmParallel(GLuint numthreads, GLuint count, GLMtask task, GLvoid* data)
+{
+    GLMwork*   work;
+    pthread_t* threads;
+    GLboolean* started;
+    GLuint     i;
+    
+    if (numthreads == 0)
+        numthreads = glmProcessors();
+    if (numthreads > count)
+        numthreads = count;
+    if (numthreads <= 1) {
+        if (count)
+            task(data, 0, count);
+        return;
     }
-  }
-  
-#if 0
-  /* announce the memory requirements */
-  printf(" Memory: %d bytes\n",
-      numvertices  * 3*sizeof(GLfloat) +
-      numnormals   * 3*sizeof(GLfloat) * (numnormals ? 1 : 0) +
-      numtexcoords * 3*sizeof(GLfloat) * (numtexcoords ? 1 : 0) +
-      numtriangles * sizeof(GLMtriangle));
-#endif
+    
+    work = (GLMwork*)malloc(sizeof(GLMwork) * numthreads);
+    threads = (pthread_t*)malloc(sizeof(pthread_t) * numthreads);
+    started = (GLboolean*)malloc(sizeof(GLboolean) * numthreads);
+    for (i = 0; i < numthreads; i++) {
+        work[i].task = task;
+        work[i].data = data;
+        work[i].begin = (GLuint)((double)count * i / numthreads);
+        work[i].end = (GLuint)((double)count * (i + 1) / numthreads);
+    }
+    
+    for (i = 1; i < numthreads; i++)
+        started[i] = !pthread_create(&threads[i], NULL, glmWorker, &work[i]);
+    glmWorker(&work[0]);
+    for (i = 1; i < numthreads; i++) {
+        /* if we couldn't get a thread, do the work here instead */
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            glmWorker(&work[i]);
+    }
+    
+    free(started);
+    free(threads);
+    free(work);
 }
 
 
-/* public functions */
+/* GLMweld: state shared by the threads welding an array of vectors.
+ * The vectors are put into cells of a uniform grid (a bit over twice
+ * epsilon wide, so all the vectors equal to one are in the 8 cells
+ * nearest to it), and the cells are hashed into buckets.
+ */
+typedef struct _GLMweld {
+    GLfloat* vectors;           /* array of GLfloat[3]'s to be welded */
+    GLfloat  epsilon;           /* maximum difference between vectors */
+    double   size;              /* size of a cell */
+    GLuint   mask;              /* number of buckets - 1 */
+    GLuint*  bucket;            /* bucket of each vector */
+    GLuint*  start;             /* where each bucket starts in order */
+    GLuint*  order;             /* vectors sorted by bucket, then index */
+    GLuint*  first;             /* first (lowest) equal vector before each */
+} GLMweld;
 
+/* largest cell coordinate; anything beyond is clamped (and such
+   vectors can only be equal if they are the same anyway) */
+#define GLM_WELD_MAXCELL 1099511627776.0
 
-/* glmUnitize: "unitize" a model by translating it to the origin and
- * scaling it to fit in a unit cube around the origin.   Returns the
- * scalefactor used.
- *
- * model - properly initialized GLMmodel structure 
- */
-GLfloat
-glmUnitize(GLMmodel* model)
+/* glmWeldHash: the bucket of a cell */
+static GLuint
+glmWeldHash(GLMweld* weld, long long x, long long y, long long z)
 {
-    GLuint  i;
-    GLfloat maxx, minx, maxy, miny, maxz, minz;
-    GLfloat cx, cy, cz, w, h, d;
-    GLfloat scale;
+    unsigned long long hash;
     
-    assert(model);
-    assert(model->vertices);
+    hash = (unsigned long long)x * 73856093ULL +
+           (unsigned long long)y * 19349663ULL +
+           (unsigned long long)z * 83492791ULL;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
     
-    /* get the max/mins */
-    maxx = minx = model->vertices[3 + 0];
-    maxy = miny = model->vertices[3 + 1];
-    maxz = minz = model->vertices[3 + 2];
-    for (i = 1; i <= model->numvertices; i++) {
-        if (maxx < model->vertices[3 * i + 0])
+    return (GLuint)hash & weld->mask;
+}
+
+/* glmWeldCells: finds the buckets of the 8 cells around a vector, its
+ * own cell first.  Along each axis the other cell is the one on the
+ * side of the half of the cell the vector is in.
+ */
+static GLvoid
+glmWeldCells(GLMweld* weld, GLfloat* v, GLuint* buckets)
+{
+    long long cell[3], side[3];
+    double c, f;
+    GLuint i;
+    
+    for (i = 0; i < 3; i++) {
+        c = v[i] / weld->size;
+        if (!(c > -GLM_WELD_MAXCELL))
+            c = -GLM_WELD_MAXCELL;
+        if (c > GLM_WELD_MAXCELL)
+            c = GLM_WELD_MAXCELL;
+        f = floor(c);
+        cell[i] = (long long)f;
+        side[i] = c - f < 0.5 ? -1 : 1;
+    }
+    
+    for (i = 0; i < 8; i++) {
+        buckets[i] = glmWeldHash(weld, 
+            cell[0] + (i & 1 ? side[0] : 0),
+            cell[1] + (i & 2 ? side[1] : 0),
+            cell[2] + (i & 4 ? side[2] : 0));
+    }
+}
+
+/* glmWeldBuckets: finds the bucket of vectors [begin, end) */
+static GLvoid
+glmWeldBuckets(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMweld* weld = (GLMweld*)data;
+    GLuint   buckets[8];
+    GLuint   i;
+    
+    for (i = begin + 1; i <= end; i++) {
+        glmWeldCells(weld, &weld->vectors[3 * i], buckets);
+        weld->bucket[i] = buckets[0];
+    }
+}
+
+/* glmWeldFirst: finds, for each of vectors [begin, end), the first
+ * vector before it that it is equal to (0 if there is none) by looking
+ * through the cells around it.
+ */
+static GLvoid
+glmWeldFirst(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMweld* weld = (GLMweld*)data;
+    GLuint   buckets[8];
+    GLuint   first, i, j, k, n;
+    
+    for (i = begin + 1; i <= end; i++) {
+        glmWeldCells(weld, &weld->vectors[3 * i], buckets);
+        first = 0;
+        for (n = 0; n < 8; n++) {
+            /* each bucket is in index order, so the first equal vector
+               in it is the lowest */
+            for (k = weld->start[buckets[n]]; 
+                 k < weld->start[buckets[n] + 1]; k++) {
+                j = weld->order[k];
+                if (j >= i || (first && j >= first))
+                    break;
+                if (glmEqual(&weld->vectors[3 * i], &weld->vectors[3 * j],
+                    weld->epsilon)) {
+                    first = j;
+                    break;
+                }
+            }
+        }
+        weld->first[i] = first;
+    }
+}
+
+/* glmWeldVectors: eliminate (weld) vectors that are within an
+ * epsilon of each other.  Each vector is welded to the first vector
+ * kept before it that it is equal to (if any), just as comparing it
+ * with every vector kept so far would, but only the vectors in the
+ * grid cells around it are looked at, so this runs in expected linear
+ * time.  The result doesn't depend on the number of threads.
+ *
+ * vectors     - array of GLfloat[3]'s to be welded
+ * numvectors - number of GLfloat[3]'s in vectors
+ * epsilon     - maximum difference between vectors 
+ * numthreads  - threads to use (0 = one per processor)
+ *
+ */
+static GLfloat*
+glmWeldVectors(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon,
+               GLuint numthreads)
+{
+    GLMweld   weld;
+    GLfloat*  copies;
+    GLuint*   kept;
+    GLuint*   next;
+    GLuint*   index;
+    GLuint    buckets[8];
+    GLuint    copied, numbuckets;
+    GLuint    i, j, k, n;
+    
+    copies = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (*numvectors + 1));
+    index = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+    
+    /* with nothing to compare, everything is kept as it is */
+    if (!(epsilon > 0)) {
+        memcpy(copies, vectors, sizeof(GLfloat) * 3 * (*numvectors + 1));
+        for (i = 1; i <= *numvectors; i++)
+            vectors[3 * i + 0] = (GLfloat)i;
+        free(index);
+        return copies;
+    }
+    
+    numbuckets = 16;
+    while (numbuckets < 2 * *numvectors)
+        numbuckets *= 2;
+    
+    weld.vectors = vectors;
+    weld.epsilon = epsilon;
+    weld.size = 2.0002 * epsilon;   /* some room for rounding */
+    weld.mask = numbuckets - 1;
+    weld.bucket = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+    weld.start = (GLuint*)calloc(numbuckets + 1, sizeof(GLuint));
+    weld.order = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+    weld.first = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+    
+    /* sort the vectors into buckets, keeping them in index order */
+    glmParallel(numthreads, *numvectors, glmWeldBuckets, &weld);
+    for (i = 1; i <= *numvectors; i++)
+        weld.start[weld.bucket[i] + 1]++;
+    for (i = 0; i < numbuckets; i++)
+        weld.start[i + 1] += weld.start[i];
+    for (i = 1; i <= *numvectors; i++)
+        weld.order[weld.start[weld.bucket[i]]++] = i;
+    for (i = numbuckets; i > 0; i--)
+        weld.start[i] = weld.start[i - 1];
+    weld.start[0] = 0;
+    
+    glmParallel(numthreads, *numvectors, glmWeldFirst, &weld);
+    
+    /* now decide which vectors are kept, in order.  Usually the first
+       equal vector is kept, and is the one to weld to.  Otherwise look
+       through the vectors kept so far in the cells around it. */
+    kept = (GLuint*)calloc(numbuckets, sizeof(GLuint));
+    next = weld.order;
+    copied = 0;
+    for (i = 1; i <= *numvectors; i++) {
+        j = weld.first[i];
+        if (j && weld.first[j] != (GLuint)-1) {
+            /* j was kept */
+        } else if (j) {
+            glmWeldCells(&weld, &vectors[3 * i], buckets);
+            j = 0;
+            for (n = 0; n < 8; n++) {
+                for (k = kept[buckets[n]]; k; k = next[k]) {
+                    if ((!j || k < j) && glmEqual(&vectors[3 * i],
+                        &vectors[3 * k], epsilon))
+                        j = k;
+                }
+            }
+        }
+        
+        if (j) {
+            index[i] = index[j];
+            weld.first[i] = (GLuint)-1;     /* welded */
+        } else {
+            /* must not be any duplicates -- add to the copies array */
+            copied++;
+            copies[3 * copied + 0] = vectors[3 * i + 0];
+            copies[3 * copied + 1] = vectors[3 * i + 1];
+            copies[3 * copied + 2] = vectors[3 * i + 2];
+            index[i] = copied;
+            next[i] = kept[weld.bucket[i]];
+            kept[weld.bucket[i]] = i;
+        }
+    }
+    
+    /* set the first component of each vector to point at the correct
+       index into the new copies array */
+    for (i = 1; i <= *numvectors; i++)
+        vectors[3 * i + 0] = (GLfloat)index[i];
+    
+    free(kept);
+    free(weld.first);
+    free(weld.order);
+    free(weld.start);
+    free(weld.bucket);
+    free(index);
+    
+    *numvectors = copied;
+    return copies;
+}
+
+
+/* GLMevent: a statement that changes the state of the parser (group,
+ * material or material library) and where among the triangles of its
+ * chunk it appeared.
+ */
+typedef struct _GLMevent {
+    char    type;               /* 'g', 'u' (usemtl) or 'm' (mtllib) */
+    GLuint  triangle;           /* triangles in the chunk before it */
+    char*   name;               /* name of the group/material/library */
+} GLMevent;
+
+/* GLMfixup: a relative (negative) index that can only be resolved once
+ * the number of elements in the preceding chunks is known.
+ */
+typedef struct _GLMfixup {
+    GLuint  triangle;           /* triangle in the chunk */
+    GLuint  slot;               /* 0-2 vindices, 3-5 nindices, 6-8 tindices */
+} GLMfixup;
+
+/* GLMchunk: everything read from one newline aligned piece of an OBJ
+ * file.  Vector arrays are 1-based just like the ones in GLMmodel.
+ */
+typedef struct _GLMchunk {
+    const char*  begin;         /* first character of the chunk */
+    const char*  end;           /* one past the last character */
+    
+    GLuint       numvertices, maxvertices;
+    GLfloat*     vertices;
+    GLuint       numnormals, maxnormals;
+    GLfloat*     normals;
+    GLuint       numtexcoords, maxtexcoords;
+    GLfloat*     texcoords;
+    GLuint       numtriangles, maxtriangles;
+    GLMtriangle* triangles;
+    GLuint       numevents, maxevents;
+    GLMevent*    events;
+    GLuint       numfixups, maxfixups;
+    GLMfixup*    fixups;
+    
+    GLuint       vertexbase;    /* elements in the preceding chunks */
+    GLuint       normalbase;
+    GLuint       texcoordbase;
+    GLuint       trianglebase;
+    
+    GLMprogress  progress;      /* told about bytes parsed (or NULL) */
+    GLvoid*      progressdata;  /* passed to progress */
+    size_t       size;          /* bytes in the whole file */
+} GLMchunk;
+
+/* glmChunkEvent: records a group/usemtl/mtllib statement in a chunk */
+static GLvoid
+glmChunkEvent(GLMchunk* chunk, char type, char* name)
+{
+    GLMevent* event;
+    
+    chunk->events = (GLMevent*)glmGrow(chunk->events, &chunk->maxevents,
+        chunk->numevents + 1, sizeof(GLMevent));
+    event = &chunk->events[chunk->numevents++];
+    event->type = type;
+    event->triangle = chunk->numtriangles;
+    event->name = strdup(name);
+}
+
+/* glmChunkIndex: turns a 1-based OBJ index into the value to store in
+ * a triangle of the chunk.  Negative indices count back from the last
+ * element read so far; they are stored relative to the start of the
+ * chunk and flagged in relative so that a fixup can be recorded for
+ * glmMergeChunks to add the number of elements in preceding chunks.
+ */
+static GLuint
+glmChunkIndex(GLint index, GLuint count, GLuint* relative, GLuint slot)
+{
+    if (index >= 0) {
+        *relative &= ~(1u << slot);
+        return index;
+    }
+    
+    /* may wrap around, which the fixup undoes */
+    *relative |= 1u << slot;
+    return count + index + 1;
+}
+
+/* glmParseChunk: reads all the data in one chunk of a Wavefront OBJ
+ * file in a single pass, growing the arrays of the chunk as elements
+ * are encountered.
+ *
+ * chunk - chunk with begin/end set and everything else zeroed
+ */
+static GLvoid
+glmParseChunk(GLMchunk* chunk)
+{
+    GLMscanner s;               /* position in the file */
+    GLuint  numcorners, i;
+    GLint   v, n, t;
+    GLMtriangle face;           /* corners of the current face */
+    GLuint  relative;           /* slots of face holding relative indices */
+    const char* reported;       /* end of what progress was told about */
+    const char* token;
+    size_t  length;
+    char    buf[128];
+    
+    s.p = chunk->begin;
+    s.end = chunk->end;
+    
+    /* element 0 of the vector arrays is unused (indices are 1-based) */
+    chunk->vertices = (GLfloat*)glmGrow(NULL, &chunk->maxvertices, 
+        1, 3 * sizeof(GLfloat));
+    chunk->normals = (GLfloat*)glmGrow(NULL, &chunk->maxnormals, 
+        1, 3 * sizeof(GLfloat));
+    chunk->texcoords = (GLfloat*)glmGrow(NULL, &chunk->maxtexcoords, 
+        1, 2 * sizeof(GLfloat));
+    
+    reported = s.p;
+    while (s.p < s.end) {
+        if (chunk->progress && s.p - reported >= GLM_PROGRESS_STEP) {
+            chunk->progress(chunk->progressdata, s.p - reported, chunk->size);
+            reported = s.p;
+        }
+        
+        token = glmScanToken(&s, &length);
+        if (!token) {
+            glmScanLine(&s);
+            continue;
+        }
+        
+        switch(token[0]) {
+        case 'v':               /* v, vn, vt */
+            switch(length > 1 ? token[1] : '\0') {
+            case '\0':          /* vertex */
+                chunk->vertices = (GLfloat*)glmGrow(chunk->vertices, 
+                    &chunk->maxvertices, chunk->numvertices + 2, 
+                    3 * sizeof(GLfloat));
+                i = 3 * ++chunk->numvertices;
+                chunk->vertices[i + 0] = chunk->vertices[i + 1] = 
+                    chunk->vertices[i + 2] = 0.0;
+                glmScanFloat(&s, &chunk->vertices[i + 0]);
+                glmScanFloat(&s, &chunk->vertices[i + 1]);
+                glmScanFloat(&s, &chunk->vertices[i + 2]);
+                break;
+            case 'n':           /* normal */
+                chunk->normals = (GLfloat*)glmGrow(chunk->normals, 
+                    &chunk->maxnormals, chunk->numnormals + 2, 
+                    3 * sizeof(GLfloat));
+                i = 3 * ++chunk->numnormals;
+                chunk->normals[i + 0] = chunk->normals[i + 1] = 
+                    chunk->normals[i + 2] = 0.0;
+                glmScanFloat(&s, &chunk->normals[i + 0]);
+                glmScanFloat(&s, &chunk->normals[i + 1]);
+                glmScanFloat(&s, &chunk->normals[i + 2]);
+                break;
+            case 't':           /* texcoord */
+                chunk->texcoords = (GLfloat*)glmGrow(chunk->texcoords, 
+                    &chunk->maxtexcoords, chunk->numtexcoords + 2, 
+                    2 * sizeof(GLfloat));
+                i = 2 * ++chunk->numtexcoords;
+                chunk->texcoords[i + 0] = chunk->texcoords[i + 1] = 0.0;
+                glmScanFloat(&s, &chunk->texcoords[i + 0]);
+                glmScanFloat(&s, &chunk->texcoords[i + 1]);
+                break;
+            default:
+                printf("glmParseChunk(): Unknown token \"%.*s\".\n", 
+                    (int)length, token);
+                exit(1);
+                break;
+            }
+            break;
+        case 'm':               /* mtllib */
+            glmChunkEvent(chunk, 'm', glmScanName(&s, buf, sizeof(buf)));
+            break;
+        case 'u':               /* usemtl */
+            glmChunkEvent(chunk, 'u', glmScanName(&s, buf, sizeof(buf)));
+            break;
+        case 'g':               /* group */
+#if SINGLE_STRING_GROUP_NAMES
+            glmChunkEvent(chunk, 'g', glmScanName(&s, buf, sizeof(buf)));
+#else
+            glmChunkEvent(chunk, 'g', glmScanRest(&s, buf, sizeof(buf)));
+#endif
+            break;
+        case 'f':               /* face */
+            /* faces with more than three corners are split into a
+               fan of triangles around the first corner: slot 0 of
+               face holds the first corner, slot 1 the previous one
+               and slot 2 the one just read */
+            numcorners = 0;
+            relative = 0;
+            while (glmScanCorner(&s, &v, &t, &n)) {
+                i = numcorners < 2 ? numcorners : 2;
+                face.vindices[i] = glmChunkIndex(v, chunk->numvertices, 
+                    &relative, 0 + i);
+                face.nindices[i] = glmChunkIndex(n, chunk->numnormals, 
+                    &relative, 3 + i);
+                face.tindices[i] = glmChunkIndex(t, chunk->numtexcoords, 
+                    &relative, 6 + i);
+                if (++numcorners < 3)
+                    continue;
+                
+                chunk->triangles = (GLMtriangle*)glmGrow(chunk->triangles,
+                    &chunk->maxtriangles, chunk->numtriangles + 1, 
+                    sizeof(GLMtriangle));
+                face.findex = 0;
+                for (i = 0; relative >> i; i++) {
+                    if (!(relative & (1u << i)))
+                        continue;
+                    chunk->fixups = (GLMfixup*)glmGrow(chunk->fixups, 
+                        &chunk->maxfixups, chunk->numfixups + 1, 
+                        sizeof(GLMfixup));
+                    chunk->fixups[chunk->numfixups].triangle = chunk->numtriangles;
+                    chunk->fixups[chunk->numfixups].slot = i;
+                    chunk->numfixups++;
+                }
+                chunk->triangles[chunk->numtriangles++] = face;
+                
+                /* the corner just read becomes the previous one */
+                face.vindices[1] = face.vindices[2];
+                face.nindices[1] = face.nindices[2];
+                face.tindices[1] = face.tindices[2];
+                relative = (relative & ~0x92u) | ((relative & 0x124u) >> 1);
+            }
+            break;
+        }
+        
+        /* eat up rest of line */
+        glmScanLine(&s);
+    }
+    
+    if (chunk->progress && s.p > reported)
+        chunk->progress(chunk->progressdata, s.p - reported, chunk->size);
+}
+
+/* glmStreamVertex: returns the vertex with a (1-based, file wide)
+ * index from the chunks whose bases are known, or NULL if there's no
+ * such vertex among them.
+ */
+static GLfloat*
+glmStreamVertex(GLMchunk* chunks, GLuint numchunks, GLuint index)
+{
+    GLuint lo, hi, mid;
+    
+    if (!numchunks || index == 0 ||
+        index > chunks[numchunks - 1].vertexbase + 
+        chunks[numchunks - 1].numvertices)
+        return NULL;
+    
+    /* binary search for the last chunk starting before the vertex */
+    lo = 0;
+    hi = numchunks - 1;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (chunks[mid].vertexbase < index)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    
+    return &chunks[lo].vertices[3 * (index - chunks[lo].vertexbase)];
+}
+
+/* glmStreamChunks: hands the triangles of chunks [first, first+count),
+ * parsed after all the ones before them, to a glmReadOBJStream()
+ * callback.
+ *
+ * chunks - all the chunks of the file
+ * first  - first of the chunks just parsed
+ * count  - number of chunks just parsed
+ * batch  - bounds so far (updated), and the batch passed to stream
+ */
+static GLvoid
+glmStreamChunks(GLMchunk* chunks, GLuint first, GLuint count, 
+                GLMbatch* batch, GLMstream stream, GLvoid* data)
+{
+    GLMchunk* chunk;
+    GLfloat*  corners[3];
+    GLfloat*  triangle;
+    GLfloat   u[3], v[3], n[3];
+    GLuint    index, fixup, i, j, k;
+    
+    /* where the chunks' vertices start, and the bounds they grow */
+    batch->numtriangles = 0;
+    for (i = first; i < first + count; i++) {
+        chunk = &chunks[i];
+        chunk->vertexbase = i ? 
+            chunks[i - 1].vertexbase + chunks[i - 1].numvertices : 0;
+        for (j = 1; j <= chunk->numvertices; j++) {
+            for (k = 0; k < 3; k++) {
+                if (batch->min[k] > chunk->vertices[3 * j + k])
+                    batch->min[k] = chunk->vertices[3 * j + k];
+                if (batch->max[k] < chunk->vertices[3 * j + k])
+                    batch->max[k] = chunk->vertices[3 * j + k];
+            }
+        }
+        batch->numtriangles += chunk->numtriangles;
+    }
+    
+    /* each triangle as its facet normal and vertex at every corner */
+    batch->triangles = (GLfloat*)malloc(sizeof(GLfloat) * 18 * 
+        (batch->numtriangles + 1));
+    triangle = batch->triangles;
+    for (i = first; i < first + count; i++) {
+        chunk = &chunks[i];
+        fixup = 0;
+        for (j = 0; j < chunk->numtriangles; j++) {
+            for (k = 0; k < 3; k++) {
+                index = chunk->triangles[j].vindices[k];
+                while (fixup < chunk->numfixups && 
+                    (chunk->fixups[fixup].triangle < j ||
+                    (chunk->fixups[fixup].triangle == j &&
+                    chunk->fixups[fixup].slot < k)))
+                    fixup++;
+                if (fixup < chunk->numfixups && 
+                    chunk->fixups[fixup].triangle == j &&
+                    chunk->fixups[fixup].slot == k)
+                    index += chunk->vertexbase;
+                corners[k] = glmStreamVertex(chunks, first + count, index);
+            }
+            if (!corners[0] || !corners[1] || !corners[2])
+                continue;
+            
+            u[0] = corners[1][0] - corners[0][0];
+            u[1] = corners[1][1] - corners[0][1];
+            u[2] = corners[1][2] - corners[0][2];
+            v[0] = corners[2][0] - corners[0][0];
+            v[1] = corners[2][1] - corners[0][1];
+            v[2] = corners[2][2] - corners[0][2];
+            glmCross(u, v, n);
+            if (n[0] != 0.0 || n[1] != 0.0 || n[2] != 0.0)
+                glmNormalize(n);
+            for (k = 0; k < 3; k++) {
+                memcpy(&triangle[0], n, sizeof(GLfloat) * 3);
+                memcpy(&triangle[3], corners[k], sizeof(GLfloat) * 3);
+                triangle += 6;
+            }
+        }
+    }
+    batch->numtriangles = (triangle - batch->triangles) / 18;
+    
+    chunk = &chunks[first + count - 1];
+    batch->parsed = chunk->end - chunks[0].begin;
+    batch->size = chunk->size;
+    stream(data, batch);
+    batch->triangles = NULL;
+}
+
+/* glmParseChunks: glmParallel task that parses chunks [begin, end) */
+static GLvoid
+glmParseChunks(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMchunk* chunks = (GLMchunk*)data;
+    GLuint i;
+    
+    for (i = begin; i < end; i++)
+        glmParseChunk(&chunks[i]);
+}
+
+/* _GLMmerge: arguments of glmCopyChunks */
+typedef struct _GLMmerge {
+    GLMmodel* model;
+    GLMchunk* chunks;
+} GLMmerge;
+
+/* glmCopyChunks: glmParallel task that copies the elements of chunks
+ * [begin, end) into their place in the model and resolves their
+ * relative indices.
+ */
+static GLvoid
+glmCopyChunks(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMmodel* model = ((GLMmerge*)data)->model;
+    GLMchunk* chunk;
+    GLMtriangle* triangle;
+    GLuint i, j;
+    
+    for (i = begin; i < end; i++) {
+        chunk = &((GLMmerge*)data)->chunks[i];
+        
+        if (chunk->vertices != model->vertices) {
+            memcpy(&model->vertices[3 * (chunk->vertexbase + 1)], 
+                &chunk->vertices[3], 
+                sizeof(GLfloat) * 3 * chunk->numvertices);
+            free(chunk->vertices);
+        }
+        if (chunk->normals != model->normals) {
+            if (chunk->numnormals)
+                memcpy(&model->normals[3 * (chunk->normalbase + 1)], 
+                    &chunk->normals[3], 
+                    sizeof(GLfloat) * 3 * chunk->numnormals);
+            free(chunk->normals);
+        }
+        if (chunk->texcoords != model->texcoords) {
+            if (chunk->numtexcoords)
+                memcpy(&model->texcoords[2 * (chunk->texcoordbase + 1)], 
+                    &chunk->texcoords[2], 
+                    sizeof(GLfloat) * 2 * chunk->numtexcoords);
+            free(chunk->texcoords);
+        }
+        if (chunk->triangles != model->triangles) {
+            if (chunk->numtriangles)
+                memcpy(&T(chunk->trianglebase), chunk->triangles, 
+                    sizeof(GLMtriangle) * chunk->numtriangles);
+            free(chunk->triangles);
+        }
+        
+        for (j = 0; j < chunk->numfixups; j++) {
+            triangle = &T(chunk->trianglebase + chunk->fixups[j].triangle);
+            switch(chunk->fixups[j].slot / 3) {
+            case 0:
+                triangle->vindices[chunk->fixups[j].slot % 3] += 
+                    chunk->vertexbase;
+                break;
+            case 1:
+                triangle->nindices[chunk->fixups[j].slot % 3] += 
+                    chunk->normalbase;
+                break;
+            case 2:
+                triangle->tindices[chunk->fixups[j].slot % 3] += 
+                    chunk->texcoordbase;
+                break;
+            }
+        }
+        free(chunk->fixups);
+    }
+}
+
+/* GLMrun: consecutive triangles of the model that belong to one group */
+typedef struct _GLMrun {
+    GLMgroup* group;
+    GLuint    first;
+    GLuint    count;
+} GLMrun;
+
+/* glmMergeChunks: puts the parsed chunks of a Wavefront OBJ file
+ * together into the model.  Each chunk's elements go after those of
+ * the chunks before it (a prefix sum over the element counts), then
+ * the group and material statements are replayed in file order to
+ * hand out the triangles to their groups.  The result is exactly
+ * what reading the file as a single chunk would produce.
+ *
+ * model     - properly initialized GLMmodel structure
+ * chunks    - parsed chunks, in file order
+ * numchunks - number of chunks
+ */
+static GLvoid
+glmMergeChunks(GLMmodel* model, GLMchunk* chunks, GLuint numchunks)
+{
+    GLMmerge  merge;
+    GLMchunk* chunk;
+    GLMevent* event;
+    GLMgroup* group;
+    GLMrun*   runs;
+    GLuint    numruns, maxruns;
+    GLuint    material, first, last;
+    GLuint    i, j, k;
+    
+    /* where each chunk's elements go */
+    for (i = 0; i < numchunks; i++) {
+        chunk = &chunks[i];
+        chunk->vertexbase = model->numvertices;
+        chunk->normalbase = model->numnormals;
+        chunk->texcoordbase = model->numtexcoords;
+        chunk->trianglebase = model->numtriangles;
+        model->numvertices += chunk->numvertices;
+        model->numnormals += chunk->numnormals;
+        model->numtexcoords += chunk->numtexcoords;
+        model->numtriangles += chunk->numtriangles;
+    }
+    
+    /* a lone chunk hands over its arrays as they are */
+    if (numchunks == 1) {
+        model->vertices = chunks[0].vertices;
+        model->normals = chunks[0].normals;
+        model->texcoords = chunks[0].texcoords;
+        model->triangles = chunks[0].triangles;
+        glmAdopt(model->arena, model->vertices, 
+            sizeof(GLfloat) * 3 * chunks[0].maxvertices);
+        glmAdopt(model->arena, model->normals, 
+            sizeof(GLfloat) * 3 * chunks[0].maxnormals);
+        glmAdopt(model->arena, model->texcoords, 
+            sizeof(GLfloat) * 2 * chunks[0].maxtexcoords);
+        glmAdopt(model->arena, model->triangles, 
+            sizeof(GLMtriangle) * chunks[0].maxtriangles);
+    } else {
+        model->vertices = (GLfloat*)glmAlloc(model->arena, sizeof(GLfloat) *
+            3 * (model->numvertices + 1));
+        model->normals = (GLfloat*)glmAlloc(model->arena, sizeof(GLfloat) *
+            3 * (model->numnormals + 1));
+        model->texcoords = (GLfloat*)glmAlloc(model->arena, sizeof(GLfloat) *
+            2 * (model->numtexcoords + 1));
+        model->triangles = (GLMtriangle*)glmAlloc(model->arena, sizeof(GLMtriangle) *
+            (model->numtriangles + 1));
+    }
+    merge.model = model;
+    merge.chunks = chunks;
+    glmParallel(model->numthreads, numchunks, glmCopyChunks, &merge);
+    
+    /* drop the arrays that turned out to be empty */
+    if (!model->numnormals) {
+        glmFree(model, model->normals);
+        model->normals = NULL;
+    }
+    if (!model->numtexcoords) {
+        glmFree(model, model->texcoords);
+        model->texcoords = NULL;
+    }
+    
+    /* read the material libraries before resolving any usemtl, no
+       matter where they are in the file */
+    for (i = 0; i < numchunks; i++) {
+        for (j = 0; j < chunks[i].numevents; j++) {
+            event = &chunks[i].events[j];
+            if (event->type != 'm')
+                continue;
+            glmFree(model, model->mtllibname);
+            model->mtllibname = glmStrdup(model->arena, event->name);
+            glmReadMTL(model, event->name);
+        }
+    }
+    
+    /* make a default group */
+    group = glmAddGroup(model, "default");
+    material = 0;
+    
+    /* replay the group and material changes in file order, noting
+       which runs of triangles go to which group */
+    runs = NULL;
+    numruns = maxruns = 0;
+    for (i = 0; i < numchunks; i++) {
+        chunk = &chunks[i];
+        first = 0;
+        for (j = 0; j <= chunk->numevents; j++) {
+            event = j < chunk->numevents ? &chunk->events[j] : NULL;
+            last = event ? event->triangle : chunk->numtriangles;
+            if (last > first) {
+                runs = (GLMrun*)glmGrow(runs, &maxruns, numruns + 1, 
+                    sizeof(GLMrun));
+                runs[numruns].group = group;
+                runs[numruns].first = chunk->trianglebase + first;
+                runs[numruns].count = last - first;
+                group->numtriangles += last - first;
+                numruns++;
+                first = last;
+            }
+            if (!event)
+                break;
+            
+            switch(event->type) {
+            case 'u':
+                group->material = material = glmFindMaterial(model, event->name);
+                break;
+            case 'g':
+                group = glmAddGroup(model, event->name);
+                group->material = material;
+                break;
+            }
+            free(event->name);
+        }
+        free(chunk->events);
+    }
+    
+    /* hand out the triangles to their groups */
+    for (group = model->groups; group; group = group->next) {
+        group->triangles = (GLuint*)glmAlloc(model->arena, 
+            sizeof(GLuint) * group->numtriangles);
+        group->numtriangles = 0;
+    }
+    for (i = 0; i < numruns; i++) {
+        group = runs[i].group;
+        for (k = 0; k < runs[i].count; k++)
+            group->triangles[group->numtriangles++] = runs[i].first + k;
+    }
+    free(runs);
+}
+
+
+/* public functions */
+
+
+/* glmUnitize: "unitize" a model by translating it to the origin and
+ * scaling it to fit in a unit cube around the origin.   Returns the
+ * scalefactor used.
+ *
+ * model - properly initialized GLMmodel structure 
+ */
+GLfloat
+glmUnitize(GLMmodel* model)
+{
+    GLuint  i;
+    GLfloat maxx, minx, maxy, miny, maxz, minz;
+    GLfloat cx, cy, cz, w, h, d;
+    GLfloat scale;
+    
+    assert(model);
+    assert(model->vertices);
+    
+    /* get the max/mins */
+    maxx = minx = model->vertices[3 + 0];
+    maxy = miny = model->vertices[3 + 1];
+    maxz = minz = model->vertices[3 + 2];
+    for (i = 1; i <= model->numvertices; i++) {
+        if (maxx < model->vertices[3 * i + 0])
             maxx = model->vertices[3 * i + 0];
         if (minx > model->vertices[3 * i + 0])
             minx = model->vertices[3 * i + 0];
@@ -869,841 +2247,3816 @@ glmDimensions(GLMmodel* model, GLfloat* dimensions)
     dimensions[2] = glmAbs(maxz) + glmAbs(minz);
 }
 
-/* glmScale: Scales a model by a given amount.
- * 
- * model - properly initialized GLMmodel structure
- * scale - scalefactor (0.5 = half as large, 2.0 = twice as large)
+/* glmScale: Scales a model by a given amount.
+ * 
+ * model - properly initialized GLMmodel structure
+ * scale - scalefactor (0.5 = half as large, 2.0 = twice as large)
+ */
+GLvoid
+glmScale(GLMmodel* model, GLfloat scale)
+{
+    GLuint i;
+    
+    for (i = 1; i <= model->numvertices; i++) {
+        model->vertices[3 * i + 0] *= scale;
+        model->vertices[3 * i + 1] *= scale;
+        model->vertices[3 * i + 2] *= scale;
+    }
+}
+
+/* glmReverseWinding: Reverse the polygon winding for all polygons in
+ * this model.   Default winding is counter-clockwise.  Also changes
+ * the direction of the normals.
+ * 
+ * model - properly initialized GLMmodel structure 
+ */
+GLvoid
+glmReverseWinding(GLMmodel* model)
+{
+    GLuint i, swap;
+    
+    assert(model);
+    glmFreeSmoothing(model);
+    
+    for (i = 0; i < model->numtriangles; i++) {
+        swap = T(i).vindices[0];
+        T(i).vindices[0] = T(i).vindices[2];
+        T(i).vindices[2] = swap;
+        
+        if (model->numnormals) {
+            swap = T(i).nindices[0];
+            T(i).nindices[0] = T(i).nindices[2];
+            T(i).nindices[2] = swap;
+        }
+        
+        if (model->numtexcoords) {
+            swap = T(i).tindices[0];
+            T(i).tindices[0] = T(i).tindices[2];
+            T(i).tindices[2] = swap;
+        }
+    }
+    
+    /* reverse facet normals */
+    for (i = 1; i <= model->numfacetnorms; i++) {
+        model->facetnorms[3 * i + 0] = -model->facetnorms[3 * i + 0];
+        model->facetnorms[3 * i + 1] = -model->facetnorms[3 * i + 1];
+        model->facetnorms[3 * i + 2] = -model->facetnorms[3 * i + 2];
+    }
+    
+    /* reverse vertex normals */
+    for (i = 1; i <= model->numnormals; i++) {
+        model->normals[3 * i + 0] = -model->normals[3 * i + 0];
+        model->normals[3 * i + 1] = -model->normals[3 * i + 1];
+        model->normals[3 * i + 2] = -model->normals[3 * i + 2];
+    }
+}
+
+#ifdef GLM_SSE
+/* glmLoad3: loads a GLfloat[3] into (x, y, z, 0) */
+static __m128
+glmLoad3(const GLfloat* p)
+{
+    return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)p),
+        _mm_load_ss(p + 2));
+}
+
+/* glmStore3: stores x, y, z of a register into a GLfloat[3] */
+static GLvoid
+glmStore3(GLfloat* p, __m128 v)
+{
+    _mm_storel_pi((__m64*)p, v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+#endif
+
+/* glmFacetNormalsRange: makes the facet normals of blocks [begin, end)
+ * of 8 triangles.  The vector paths do 8 (AVX2) or 4 (SSE) triangles
+ * at a time and normalize with a reciprocal square root estimate
+ * refined by a step of Newton's method.  Only the last few triangles
+ * of the model are left to the scalar code, so the normals don't
+ * depend on how the blocks are split between threads.
+ */
+static GLvoid
+glmFacetNormalsRange(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMmodel* model = (GLMmodel*)data;
+    GLfloat*  vertices = model->vertices;
+    GLfloat*  n;
+    GLfloat*  p0;
+    GLfloat*  p1;
+    GLfloat*  p2;
+    GLfloat   u[3], v[3], l;
+    GLuint    i;
+    
+    begin *= 8;
+    end = end * 8 < model->numtriangles ? end * 8 : model->numtriangles;
+#if defined(GLM_AVX2)
+    __m256i stride, three, index[3];
+    __m256  p[3][3], ux, uy, uz, vx, vy, vz, nx, ny, nz, l2, r;
+    GLfloat x[8], y[8], z[8];
+    GLuint  j, k, c;
+    
+    /* offsets of the vertex indices of 8 triangles in a row */
+    stride = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+        _mm256_set1_epi32(sizeof(GLMtriangle) / sizeof(GLuint)));
+    three = _mm256_set1_epi32(3);
+    for (i = begin; i + 8 <= end; i += 8) {
+        for (k = 0; k < 3; k++) {
+            index[k] = _mm256_mullo_epi32(three, _mm256_i32gather_epi32(
+                (const int*)&T(i).vindices[k], stride, 4));
+            for (c = 0; c < 3; c++)
+                p[k][c] = _mm256_i32gather_ps(vertices + c, index[k], 4);
+        }
+        ux = _mm256_sub_ps(p[1][0], p[0][0]);
+        uy = _mm256_sub_ps(p[1][1], p[0][1]);
+        uz = _mm256_sub_ps(p[1][2], p[0][2]);
+        vx = _mm256_sub_ps(p[2][0], p[0][0]);
+        vy = _mm256_sub_ps(p[2][1], p[0][1]);
+        vz = _mm256_sub_ps(p[2][2], p[0][2]);
+        nx = _mm256_sub_ps(_mm256_mul_ps(uy, vz), _mm256_mul_ps(uz, vy));
+        ny = _mm256_sub_ps(_mm256_mul_ps(uz, vx), _mm256_mul_ps(ux, vz));
+        nz = _mm256_sub_ps(_mm256_mul_ps(ux, vy), _mm256_mul_ps(uy, vx));
+        l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), 
+            _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz));
+        r = _mm256_rsqrt_ps(l2);
+        r = _mm256_mul_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.5f), 
+            _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), l2), 
+            _mm256_mul_ps(r, r))));
+        _mm256_storeu_ps(x, _mm256_mul_ps(nx, r));
+        _mm256_storeu_ps(y, _mm256_mul_ps(ny, r));
+        _mm256_storeu_ps(z, _mm256_mul_ps(nz, r));
+        
+        n = &model->facetnorms[3 * (i + 1)];
+        for (j = 0; j < 8; j++) {
+            T(i + j).findex = i + j + 1;
+            n[3 * j + 0] = x[j];
+            n[3 * j + 1] = y[j];
+            n[3 * j + 2] = z[j];
+        }
+    }
+#elif defined(GLM_SSE)
+    __m128  a, nv[4], x, y, z, w, l2, r;
+    GLuint  j;
+    
+    for (i = begin; i + 4 <= end; i += 4) {
+        /* cross products of 4 triangles, one per register (x, y, z, 0) */
+        for (j = 0; j < 4; j++) {
+            a = glmLoad3(&vertices[3 * T(i + j).vindices[0]]);
+            x = _mm_sub_ps(glmLoad3(&vertices[3 * T(i + j).vindices[1]]), a);
+            y = _mm_sub_ps(glmLoad3(&vertices[3 * T(i + j).vindices[2]]), a);
+            nv[j] = _mm_sub_ps(
+                _mm_mul_ps(_mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 0, 2, 1)),
+                           _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 1, 0, 2))),
+                _mm_mul_ps(_mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 1, 0, 2)),
+                           _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 0, 2, 1))));
+        }
+        
+        /* their lengths, all at once */
+        x = nv[0]; y = nv[1]; z = nv[2]; w = nv[3];
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+            _mm_mul_ps(z, z));
+        r = _mm_rsqrt_ps(l2);
+        r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), 
+            _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), l2), _mm_mul_ps(r, r))));
+        
+        n = &model->facetnorms[3 * (i + 1)];
+        glmStore3(n + 0, _mm_mul_ps(nv[0], _mm_shuffle_ps(r, r, 0x00)));
+        glmStore3(n + 3, _mm_mul_ps(nv[1], _mm_shuffle_ps(r, r, 0x55)));
+        glmStore3(n + 6, _mm_mul_ps(nv[2], _mm_shuffle_ps(r, r, 0xaa)));
+        glmStore3(n + 9, _mm_mul_ps(nv[3], _mm_shuffle_ps(r, r, 0xff)));
+        for (j = 0; j < 4; j++)
+            T(i + j).findex = i + j + 1;
+    }
+#else
+    i = begin;
+#endif
+    
+    /* whatever is left over (or everything, without vectors) */
+    for (; i < end; i++) {
+        T(i).findex = i + 1;
+        p0 = &vertices[3 * T(i).vindices[0]];
+        p1 = &vertices[3 * T(i).vindices[1]];
+        p2 = &vertices[3 * T(i).vindices[2]];
+        
+        u[0] = p1[0] - p0[0];
+        u[1] = p1[1] - p0[1];
+        u[2] = p1[2] - p0[2];
+        
+        v[0] = p2[0] - p0[0];
+        v[1] = p2[1] - p0[1];
+        v[2] = p2[2] - p0[2];
+        
+        n = &model->facetnorms[3 * (i + 1)];
+        glmCross(u, v, n);
+        l = 1.0f / (GLfloat)sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        n[0] *= l;
+        n[1] *= l;
+        n[2] *= l;
+    }
+}
+
+/* glmFacetNormals: Generates facet normals for a model (by taking the
+ * cross product of the two vectors derived from the sides of each
+ * triangle).  Assumes a counter-clockwise winding.  The old facet
+ * normals array is reused if the number of triangles hasn't changed.
+ *
+ * model - initialized GLMmodel structure
+ */
+GLvoid
+glmFacetNormals(GLMmodel* model)
+{
+    assert(model);
+    assert(model->vertices);
+    
+    glmFreeSmoothing(model);
+    
+    /* the old facet normals can be overwritten if there are as many */
+    if (!model->facetnorms || model->numfacetnorms != model->numtriangles) {
+        glmFree(model, model->facetnorms);
+        model->numfacetnorms = model->numtriangles;
+        model->facetnorms = (GLfloat*)glmAlloc(model->arena, sizeof(GLfloat) *
+                           3 * (model->numfacetnorms + 1));
+    }
+    
+    glmParallel(model->numtriangles < GLM_FACET_GRAIN ? 1 : model->numthreads,
+        (model->numtriangles + 7) / 8, glmFacetNormalsRange, model);
+}
+
+
+/* GLMsmooth: state shared by the threads making vertex normals.  The
+ * triangles each vertex is in are listed in compressed sparse row
+ * form: those of vertex i are triangles[start[i]] up to (not
+ * including) triangles[start[i + 1]], highest index first.
+ */
+typedef struct _GLMsmooth {
+    GLMmodel* model;
+    GLfloat   cos_angle;        /* cosine of the smoothing angle */
+    GLuint*   start;            /* where each vertex's triangles start */
+    GLuint*   triangles;        /* triangles each vertex is in */
+    GLubyte*  corners;          /* which corner of each the vertex is */
+    GLubyte*  averaged;         /* whether each of them is averaged */
+    GLuint*   first;            /* first normal of each vertex */
+} GLMsmooth;
+
+/* glmVertexTriangles: lists the triangles each vertex of a model is in
+ * (see GLMsmooth): counts them, makes room for them, then fills them
+ * in, last triangle first (as the lists have always been).
+ *
+ * model     - initialized GLMmodel structure
+ * start     - will point at where each vertex's triangles start
+ * triangles - will point at the triangles of every vertex
+ * corners   - if not NULL, will point at which corner of each of
+ *             those triangles the vertex is
+ */
+static GLvoid
+glmVertexTriangles(GLMmodel* model, GLuint** start, GLuint** triangles,
+                   GLubyte** corners)
+{
+    GLuint i, j, k;
+    
+    *start = (GLuint*)calloc(model->numvertices + 2, sizeof(GLuint));
+    *triangles = (GLuint*)malloc(sizeof(GLuint) * 
+        (3 * model->numtriangles + 1));
+    if (corners)
+        *corners = (GLubyte*)malloc(sizeof(GLubyte) * 
+            (3 * model->numtriangles + 1));
+    
+    for (i = 0; i < model->numtriangles; i++) {
+        (*start)[T(i).vindices[0] + 1]++;
+        (*start)[T(i).vindices[1] + 1]++;
+        (*start)[T(i).vindices[2] + 1]++;
+    }
+    for (i = 1; i <= model->numvertices; i++)
+        (*start)[i + 1] += (*start)[i];
+    for (i = model->numtriangles; i > 0; i--) {
+        for (j = 0; j < 3; j++) {
+            k = (*start)[T(i - 1).vindices[j]]++;
+            (*triangles)[k] = i - 1;
+            if (corners)
+                (*corners)[k] = j;
+        }
+    }
+    for (i = model->numvertices + 1; i > 1; i--)
+        (*start)[i] = (*start)[i - 1];
+    (*start)[1] = 0;
+}
+
+/* glmSmoothCount: decides which facet normals are averaged for
+ * vertices [begin, end) and counts the normals each of them needs.
+ */
+static GLvoid
+glmSmoothCount(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMsmooth* smooth = (GLMsmooth*)data;
+    GLMmodel*  model = smooth->model;
+    GLfloat*   facetnorm;
+    GLfloat    dot;
+    GLuint     i, j, count, avg;
+    
+    for (i = begin + 1; i <= end; i++) {
+        if (smooth->start[i] == smooth->start[i + 1])
+            fprintf(stderr, "glmVertexNormals(): vertex w/o a triangle\n");
+        
+        /* only average if the dot product of the angle between the two
+        facet normals is greater than the cosine of the threshold
+        angle -- or, said another way, the angle between the two
+        facet normals is less than (or equal to) the threshold angle */
+        facetnorm = &model->facetnorms[3 * 
+            T(smooth->triangles[smooth->start[i]]).findex];
+        count = avg = 0;
+        for (j = smooth->start[i]; j < smooth->start[i + 1]; j++) {
+            dot = glmDot(&model->facetnorms[3 * 
+                T(smooth->triangles[j]).findex], facetnorm);
+            smooth->averaged[j] = dot > smooth->cos_angle;
+            if (smooth->averaged[j])
+                avg = 1;        /* we averaged at least one normal! */
+            else
+                count++;        /* this one keeps its facet normal */
+        }
+        smooth->first[i] = avg + count;
+    }
+}
+
+/* glmSmoothNormals: makes the normals of vertices [begin, end) and
+ * sets the normal indices of the triangles they are in.
+ */
+static GLvoid
+glmSmoothNormals(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMsmooth* smooth = (GLMsmooth*)data;
+    GLMmodel*  model = smooth->model;
+    GLfloat*   facetnorm;
+    GLfloat    average[3];
+    GLuint     i, j, k, t, numnormals, avg;
+    
+    for (i = begin + 1; i <= end; i++) {
+        numnormals = smooth->first[i];
+        
+        /* calculate an average normal for this vertex by averaging the
+        facet normal of every triangle this vertex is in */
+        average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
+        avg = 0;
+        for (j = smooth->start[i]; j < smooth->start[i + 1]; j++) {
+            if (smooth->averaged[j]) {
+                facetnorm = &model->facetnorms[3 * 
+                    T(smooth->triangles[j]).findex];
+                average[0] += facetnorm[0];
+                average[1] += facetnorm[1];
+                average[2] += facetnorm[2];
+                avg = 1;
+            }
+        }
+        
+        if (avg) {
+            /* normalize the averaged normal */
+            glmNormalize(average);
+            
+            /* add the normal to the vertex normals list */
+            model->normals[3 * numnormals + 0] = average[0];
+            model->normals[3 * numnormals + 1] = average[1];
+            model->normals[3 * numnormals + 2] = average[2];
+            avg = numnormals;
+            numnormals++;
+        }
+        
+        /* set the normal of this vertex in each triangle it is in */
+        for (j = smooth->start[i]; j < smooth->start[i + 1]; j++) {
+            t = smooth->triangles[j];
+            k = smooth->corners[j];
+            if (smooth->averaged[j]) {
+                /* if this one was averaged, use the average normal */
+                T(t).nindices[k] = avg;
+            } else {
+                /* if this one wasn't averaged, use the facet normal */
+                facetnorm = &model->facetnorms[3 * T(t).findex];
+                model->normals[3 * numnormals + 0] = facetnorm[0];
+                model->normals[3 * numnormals + 1] = facetnorm[1];
+                model->normals[3 * numnormals + 2] = facetnorm[2];
+                T(t).nindices[k] = numnormals;
+                numnormals++;
+            }
+        }
+    }
+}
+
+/* glmVertexNormals: Generates smooth vertex normals for a model.
+ * First builds a list of all the triangles each vertex is in.   Then
+ * loops through each vertex in the the list averaging all the facet
+ * normals of the triangles each vertex is in.   Finally, sets the
+ * normal index in the triangle for the vertex to the generated smooth
+ * normal.   If the dot product of a facet normal and the facet normal
+ * associated with the first triangle in the list of triangles the
+ * current vertex is in is greater than the cosine of the angle
+ * parameter to the function, that facet normal is not added into the
+ * average normal calculation and the corresponding vertex is given
+ * the facet normal.  This tends to preserve hard edges.  The angle to
+ * use depends on the model, but 90 degrees is usually a good start.
+ *
+ * model - initialized GLMmodel structure
+ * angle - maximum angle (in degrees) to smooth across
+ */
+GLvoid
+glmVertexNormals(GLMmodel* model, GLfloat angle)
+{
+    GLMsmooth smooth;
+    GLuint    numnormals, count;
+    GLuint    i;
+    
+    assert(model);
+    assert(model->facetnorms);
+    
+    /* calculate the cosine of the angle (in degrees) */
+    smooth.model = model;
+    smooth.cos_angle = cos(angle * M_PI / 180.0);
+    
+    /* nuke any previous normals */
+    glmFree(model, model->normals);
+    glmFreeSmoothing(model);
+    
+    glmVertexTriangles(model, &smooth.start, &smooth.triangles, 
+        &smooth.corners);
+    smooth.averaged = (GLubyte*)malloc(sizeof(GLubyte) * 
+        (3 * model->numtriangles + 1));
+    smooth.first = (GLuint*)malloc(sizeof(GLuint) * (model->numvertices + 1));
+    
+    /* count the normals each vertex needs, so that every vertex knows
+    where its normals go and the normals array is just big enough */
+    glmParallel(model->numthreads, model->numvertices, glmSmoothCount, 
+        &smooth);
+    numnormals = 1;
+    for (i = 1; i <= model->numvertices; i++) {
+        count = smooth.first[i];
+        smooth.first[i] = numnormals;
+        numnormals += count;
+    }
+    model->numnormals = numnormals - 1;
+    model->normals = (GLfloat*)glmAlloc(model->arena, 
+        sizeof(GLfloat) * 3 * (model->numnormals + 1));
+    
+    glmParallel(model->numthreads, model->numvertices, glmSmoothNormals, 
+        &smooth);
+    
+    free(smooth.first);
+    free(smooth.averaged);
+    free(smooth.corners);
+    free(smooth.triangles);
+    free(smooth.start);
+}
+
+
+/* glmSmoothingDots: finds the dot products for vertices [begin, end) */
+static GLvoid
+glmSmoothingDots(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMsmoothing* smoothing = (GLMsmoothing*)data;
+    GLMmodel*     model = smoothing->model;
+    GLfloat*      facetnorm;
+    GLfloat       dot;
+    GLuint        i, j;
+    
+    for (i = begin + 1; i <= end; i++) {
+        if (smoothing->start[i] == smoothing->start[i + 1])
+            continue;
+        facetnorm = &model->facetnorms[3 * 
+            T(smoothing->triangles[smoothing->start[i]]).findex];
+        for (j = smoothing->start[i]; j < smoothing->start[i + 1]; j++) {
+            dot = glmDot(&model->facetnorms[3 * 
+                T(smoothing->triangles[j]).findex], facetnorm);
+            
+            /* a degenerate triangle is never averaged, whatever the
+               angle, so keep it out of the way (cosines are >= -1) */
+            smoothing->dots[j] = dot == dot ? dot : -2.0;
+        }
+    }
+}
+
+/* glmSmoothingVertices: remakes the normals of the vertices in the
+ * update list from [begin, end), just as glmSmoothNormals() does.
+ */
+static GLvoid
+glmSmoothingVertices(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMsmoothing* smoothing = (GLMsmoothing*)data;
+    GLMmodel*     model = smoothing->model;
+    GLfloat*      facetnorm;
+    GLfloat*      normal;
+    GLfloat       average[3];
+    GLuint        i, j, n, t, avg, averaged;
+    
+    for (n = begin; n < end; n++) {
+        i = smoothing->vertices[n];
+        avg = smoothing->start[i] + i;
+        
+        average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
+        averaged = 0;
+        for (j = smoothing->start[i]; j < smoothing->start[i + 1]; j++) {
+            t = smoothing->triangles[j];
+            facetnorm = &model->facetnorms[3 * T(t).findex];
+            if (smoothing->dots[j] > smoothing->cos_angle) {
+                average[0] += facetnorm[0];
+                average[1] += facetnorm[1];
+                average[2] += facetnorm[2];
+                averaged = 1;
+                T(t).nindices[smoothing->corners[j]] = avg;
+            } else {
+                /* not averaged, so this corner gets the facet normal */
+                normal = &model->normals[3 * (avg + 1 + j - 
+                    smoothing->start[i])];
+                normal[0] = facetnorm[0];
+                normal[1] = facetnorm[1];
+                normal[2] = facetnorm[2];
+                T(t).nindices[smoothing->corners[j]] = 
+                    avg + 1 + j - smoothing->start[i];
+            }
+        }
+        
+        /* (unused if nothing was averaged) */
+        if (averaged)
+            glmNormalize(average);
+        model->normals[3 * avg + 0] = average[0];
+        model->normals[3 * avg + 1] = average[1];
+        model->normals[3 * avg + 2] = average[2];
+    }
+}
+
+/* glmSortDots: sorts the indices of the dot products by their value
+ * (a radix sort, on the bits of the floats made to sort as integers).
+ */
+static GLvoid
+glmSortDots(GLfloat* dots, GLuint* sorted, GLuint count)
+{
+    GLuint* keys;
+    GLuint* tempkeys;
+    GLuint* temp;
+    GLuint* swap;
+    GLuint  counts[257];
+    GLuint  i, key, pass;
+    
+    keys = (GLuint*)malloc(sizeof(GLuint) * (count + 1));
+    tempkeys = (GLuint*)malloc(sizeof(GLuint) * (count + 1));
+    temp = (GLuint*)malloc(sizeof(GLuint) * (count + 1));
+    for (i = 0; i < count; i++) {
+        memcpy(&key, &dots[i], sizeof(GLuint));
+        keys[i] = key & 0x80000000 ? ~key : key | 0x80000000;
+        sorted[i] = i;
+    }
+    
+    for (pass = 0; pass < 32; pass += 8) {
+        memset(counts, 0, sizeof(counts));
+        for (i = 0; i < count; i++)
+            counts[((keys[i] >> pass) & 0xff) + 1]++;
+        for (i = 0; i < 256; i++)
+            counts[i + 1] += counts[i];
+        for (i = 0; i < count; i++) {
+            key = (keys[i] >> pass) & 0xff;
+            tempkeys[counts[key]] = keys[i];
+            temp[counts[key]++] = sorted[i];
+        }
+        swap = keys; keys = tempkeys; tempkeys = swap;
+        swap = sorted; sorted = temp; temp = swap;
+    }
+    
+    /* after an even number of passes the result is back in place */
+    free(temp);
+    free(tempkeys);
+    free(keys);
+}
+
+/* glmSmoothingFind: returns how many of the (sorted) dot products are
+ * less than or equal to value.
+ */
+static GLuint
+glmSmoothingFind(GLMsmoothing* smoothing, GLfloat value)
+{
+    GLuint low, high, middle;
+    
+    low = 0;
+    high = smoothing->start[smoothing->model->numvertices + 1];
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (smoothing->dots[smoothing->sorted[middle]] <= value)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    
+    return low;
+}
+
+/* glmSmoothingVertex: returns the vertex a triangle in the lists is of */
+static GLuint
+glmSmoothingVertex(GLMsmoothing* smoothing, GLuint entry)
+{
+    GLuint low, high, middle;
+    
+    /* the last vertex whose triangles start at or before entry */
+    low = 1;
+    high = smoothing->model->numvertices;
+    while (low < high) {
+        middle = low + (high - low + 1) / 2;
+        if (smoothing->start[middle] <= entry)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    
+    return low;
+}
+
+/* glmSmoothingAngle: Changes the smoothing angle of the vertex normals
+ * of a model, with the same result as glmVertexNormals() would give
+ * (but laid out differently).  The first call makes the normals much
+ * like glmVertexNormals() does, but keeps what it finds out about
+ * them, so that later calls only have to remake the normals of the
+ * vertices where some triangle goes from being averaged to not (or
+ * back).  Anything else that changes the normals (or the triangles)
+ * starts this over.
+ *
+ * model - initialized GLMmodel structure
+ * angle - maximum angle (in degrees) to smooth across
+ */
+GLvoid
+glmSmoothingAngle(GLMmodel* model, GLfloat angle)
+{
+    GLMsmoothing* smoothing;
+    GLfloat  cos_angle, low, high;
+    GLuint   first, last, count, i, j;
+    
+    assert(model);
+    assert(model->facetnorms);
+    
+    cos_angle = cos(angle * M_PI / 180.0);
+    smoothing = model->smoothing;
+    
+    if (!smoothing) {
+        smoothing = (GLMsmoothing*)malloc(sizeof(GLMsmoothing));
+        smoothing->model = model;
+        smoothing->cos_angle = cos_angle;
+        glmVertexTriangles(model, &smoothing->start, &smoothing->triangles,
+            &smoothing->corners);
+        count = smoothing->start[model->numvertices + 1];
+        smoothing->dots = (GLfloat*)malloc(sizeof(GLfloat) * (count + 1));
+        smoothing->sorted = (GLuint*)malloc(sizeof(GLuint) * (count + 1));
+        smoothing->mark = (GLuint*)calloc(model->numvertices + 1, 
+            sizeof(GLuint));
+        smoothing->update = 0;
+        smoothing->vertices = (GLuint*)malloc(sizeof(GLuint) * 
+            (model->numvertices + 1));
+        
+        glmParallel(model->numthreads, model->numvertices, glmSmoothingDots,
+            smoothing);
+        glmSortDots(smoothing->dots, smoothing->sorted, count);
+        
+        /* each vertex gets an average normal and one per triangle */
+        glmFree(model, model->normals);
+        model->numnormals = model->numvertices + count;
+        model->normals = (GLfloat*)glmAlloc(model->arena, sizeof(GLfloat) * 
+            3 * (model->numnormals + 1));
+        
+        for (i = 1; i <= model->numvertices; i++) {
+            if (smoothing->start[i] == smoothing->start[i + 1])
+                fprintf(stderr, "glmSmoothingAngle(): vertex w/o a triangle\n");
+            smoothing->vertices[i - 1] = i;
+        }
+        smoothing->numvertices = model->numvertices;
+        model->smoothing = smoothing;
+    } else {
+        /* the triangles that change are the ones whose dot product is
+           between the old and the new cosine */
+        low = smoothing->cos_angle < cos_angle ? smoothing->cos_angle : cos_angle;
+        high = glmMax(smoothing->cos_angle, cos_angle);
+        first = glmSmoothingFind(smoothing, low);
+        last = glmSmoothingFind(smoothing, high);
+        smoothing->cos_angle = cos_angle;
+        
+        /* collect their vertices (once each), unless there are so many
+           that going through all the vertices in order is quicker */
+        smoothing->update++;
+        smoothing->numvertices = 0;
+        if (last - first > smoothing->start[model->numvertices + 1] / 8) {
+            for (i = 1; i <= model->numvertices; i++)
+                smoothing->vertices[smoothing->numvertices++] = i;
+            first = last;
+        }
+        for (j = first; j < last; j++) {
+            i = glmSmoothingVertex(smoothing, smoothing->sorted[j]);
+            if (smoothing->mark[i] != smoothing->update) {
+                smoothing->mark[i] = smoothing->update;
+                smoothing->vertices[smoothing->numvertices++] = i;
+            }
+        }
+    }
+    
+    glmParallel(model->numthreads, smoothing->numvertices, 
+        glmSmoothingVertices, smoothing);
+}
+
+
+/* glmLinearTexture: Generates texture coordinates according to a
+ * linear projection of the texture map.  It generates these by
+ * linearly mapping the vertices onto a square.
+ *
+ * model - pointer to initialized GLMmodel structure
+ */
+GLvoid
+glmLinearTexture(GLMmodel* model)
+{
+    GLMgroup *group;
+    GLfloat dimensions[3];
+    GLfloat x, y, scalefactor;
+    GLuint i;
+    
+    assert(model);
+    
+    glmFree(model, model->texcoords);
+    model->numtexcoords = model->numvertices;
+    model->texcoords = (GLfloat*)glmAlloc(model->arena, 
+        sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
+    
+    glmDimensions(model, dimensions);
+    scalefactor = 2.0 / 
+        glmAbs(glmMax(glmMax(dimensions[0], dimensions[1]), dimensions[2]));
+    
+    /* do the calculations */
+    for(i = 1; i <= model->numvertices; i++) {
+        x = model->vertices[3 * i + 0] * scalefactor;
+        y = model->vertices[3 * i + 2] * scalefactor;
+        model->texcoords[2 * i + 0] = (x + 1.0) / 2.0;
+        model->texcoords[2 * i + 1] = (y + 1.0) / 2.0;
+    }
+    
+    /* go through and put texture coordinate indices in all the triangles */
+    group = model->groups;
+    while(group) {
+        for(i = 0; i < group->numtriangles; i++) {
+            T(group->triangles[i]).tindices[0] = T(group->triangles[i]).vindices[0];
+            T(group->triangles[i]).tindices[1] = T(group->triangles[i]).vindices[1];
+            T(group->triangles[i]).tindices[2] = T(group->triangles[i]).vindices[2];
+        }    
+        group = group->next;
+    }
+    
+#if 0
+    printf("glmLinearTexture(): generated %d linear texture coordinates\n",
+        model->numtexcoords);
+#endif
+}
+
+/* glmSpheremapTexture: Generates texture coordinates according to a
+ * spherical projection of the texture map.  Sometimes referred to as
+ * spheremap, or reflection map texture coordinates.  It generates
+ * these by using the normal to calculate where that vertex would map
+ * onto a sphere.  Since it is impossible to map something flat
+ * perfectly onto something spherical, there is distortion at the
+ * poles.  This particular implementation causes the poles along the X
+ * axis to be distorted.
+ *
+ * model - pointer to initialized GLMmodel structure
+ */
+GLvoid
+glmSpheremapTexture(GLMmodel* model)
+{
+    GLMgroup* group;
+    GLfloat theta, phi, rho, x, y, z, r;
+    GLuint i;
+    
+    assert(model);
+    assert(model->normals);
+    
+    glmFree(model, model->texcoords);
+    model->numtexcoords = model->numnormals;
+    model->texcoords = (GLfloat*)glmAlloc(model->arena, 
+        sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
+    
+    for (i = 1; i <= model->numnormals; i++) {
+        z = model->normals[3 * i + 0];  /* re-arrange for pole distortion */
+        y = model->normals[3 * i + 1];
+        x = model->normals[3 * i + 2];
+        r = sqrt((x * x) + (y * y));
+        rho = sqrt((r * r) + (z * z));
+        
+        if(r == 0.0) {
+            theta = 0.0;
+            phi = 0.0;
+        } else {
+            if(z == 0.0)
+                phi = 3.14159265 / 2.0;
+            else
+                phi = acos(z / rho);
+            
+            if(y == 0.0)
+                theta = 3.141592365 / 2.0;
+            else
+                theta = asin(y / r) + (3.14159265 / 2.0);
+        }
+        
+        model->texcoords[2 * i + 0] = theta / 3.14159265;
+        model->texcoords[2 * i + 1] = phi / 3.14159265;
+    }
+    
+    /* go through and put texcoord indices in all the triangles */
+    group = model->groups;
+    while(group) {
+        for (i = 0; i < group->numtriangles; i++) {
+            T(group->triangles[i]).tindices[0] = T(group->triangles[i]).nindices[0];
+            T(group->triangles[i]).tindices[1] = T(group->triangles[i]).nindices[1];
+            T(group->triangles[i]).tindices[2] = T(group->triangles[i]).nindices[2];
+        }
+        group = group->next;
+    }
+}
+
+/* glmDelete: Deletes a GLMmodel structure.
+ *
+ * model - initialized GLMmodel structure
+ */
+GLvoid
+glmDelete(GLMmodel* model)
+{
+    assert(model);
+    
+    glmFreeSmoothing(model);
+    if (model->mapping)
+        munmap(model->mapping, model->mappingsize);
+    
+    /* everything else, the model included, is in its arena */
+    glmFreeArena(model->arena);
+}
+
+/* glmMemory: Returns the bytes of memory a model takes up (not
+ * counting what glmSmoothingAngle() keeps).
+ *
+ * model - initialized GLMmodel structure
+ */
+size_t
+glmMemory(GLMmodel* model)
+{
+    assert(model);
+    
+    return glmArenaSize(model->arena) + model->mappingsize;
+}
+
+/* glmEmptyModel: allocates a model, with nothing in it yet, for a
+ * file that is about to be read.
+ */
+static GLMmodel*
+glmEmptyModel(char* filename, GLuint numthreads)
+{
+    GLMmodel* model;
+    
+    model = glmNewModel();
+    model->pathname    = glmStrdup(model->arena, filename);
+    model->mtllibname    = NULL;
+    model->numvertices   = 0;
+    model->vertices    = NULL;
+    model->numnormals    = 0;
+    model->normals     = NULL;
+    model->numtexcoords  = 0;
+    model->texcoords       = NULL;
+    model->numfacetnorms = 0;
+    model->facetnorms    = NULL;
+    model->numtriangles  = 0;
+    model->triangles       = NULL;
+    model->nummaterials  = 0;
+    model->materials       = NULL;
+    model->numgroups       = 0;
+    model->groups      = NULL;
+    model->grouparray    = NULL;
+    model->grouphash     = NULL;
+    model->grouphashsize = 0;
+    model->materialhash  = NULL;
+    model->materialhashsize = 0;
+    model->smoothing     = NULL;
+    model->position[0]   = 0.0;
+    model->position[1]   = 0.0;
+    model->position[2]   = 0.0;
+    model->numthreads    = numthreads;
+    model->mapping       = NULL;
+    model->mappingsize   = 0;
+    
+    return model;
+}
+
+static GLMmodel* glmReadOBJFile(char* filename, GLuint numthreads, 
+    GLMprogress progress, GLMstream stream, GLvoid* data);
+
+/* glmReadOBJ: Reads a model description from a Wavefront .OBJ file.
+ * Returns a pointer to the created object which should be free'd with
+ * glmDelete().
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.  
+ */
+GLMmodel* 
+glmReadOBJ(char* filename)
+{
+    return glmReadOBJThreads(filename, 0);
+}
+
+/* glmReadOBJThreads: Reads a model description from a Wavefront .OBJ
+ * file, parsing newline aligned chunks of it on separate threads.
+ * The model is the same no matter how many threads are used.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ */
+GLMmodel* 
+glmReadOBJThreads(char* filename, GLuint numthreads)
+{
+    return glmReadOBJProgress(filename, numthreads, NULL, NULL);
+}
+
+/* glmReadOBJProgress: Reads a model description from a Wavefront .OBJ
+ * file like glmReadOBJThreads(), telling a callback how far along the
+ * parsing is as it goes.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ * progress   - called with data, a number of bytes just parsed and the
+ *              size of the file, every so often (from any of the
+ *              parsing threads, possibly at once) 
+ * data       - passed to progress
+ */
+GLMmodel* 
+glmReadOBJProgress(char* filename, GLuint numthreads, GLMprogress progress,
+                   GLvoid* data)
+{
+    return glmReadOBJFile(filename, numthreads, progress, NULL, data);
+}
+
+/* glmReadOBJStream: Reads a model description from a Wavefront .OBJ
+ * file like glmReadOBJThreads(), handing the triangles read to a
+ * callback in batches while the rest of the file is still being read.
+ * The file is parsed in pieces of GLM_STREAM_SIZE bytes, as many at a
+ * time as there are threads, and a batch goes out after each round.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ * stream     - called with data and each batch, on the calling thread
+ * data       - passed to stream
+ */
+GLMmodel* 
+glmReadOBJStream(char* filename, GLuint numthreads, GLMstream stream,
+                 GLvoid* data)
+{
+    return glmReadOBJFile(filename, numthreads, NULL, stream, data);
+}
+
+/* glmReadOBJFile: reads a Wavefront .OBJ file (see glmReadOBJProgress()
+ * and glmReadOBJStream(), at most one of progress and stream is given).
+ */
+static GLMmodel* 
+glmReadOBJFile(char* filename, GLuint numthreads, GLMprogress progress,
+               GLMstream stream, GLvoid* data)
+{
+    GLMmodel* model;
+    GLMchunk* chunks;
+    GLMbatch  batch;
+    GLuint  numchunks, count, i;
+    size_t  size;
+    char*   file;
+    char*   begin;
+    char*   end;
+    
+    /* map the whole file into memory so it is read only once */
+    file = glmMapFile(filename, &size);
+    if (file == (char*)MAP_FAILED) {
+        fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    
+    /* allocate a new model */
+    model = glmEmptyModel(filename, numthreads);
+    
+    /* split the file into one chunk per thread (small files aren't
+       worth splitting), or into pieces to stream, each ending just
+       after a newline */
+    if (!numthreads)
+        numthreads = glmProcessors();
+    if (stream) {
+        numchunks = size / GLM_STREAM_SIZE + 1;
+    } else {
+        numchunks = size / GLM_CHUNK_SIZE + 1;
+        if (numchunks > numthreads)
+            numchunks = numthreads;
+    }
+    chunks = (GLMchunk*)calloc(numchunks, sizeof(GLMchunk));
+    begin = file;
+    for (i = 0; i < numchunks; i++) {
+        end = file + (size_t)((double)size * (i + 1) / numchunks);
+        if (end < begin)
+            end = begin;
+        if (i < numchunks - 1) {
+            while (end < file + size && end[-1] != '\n')
+                end++;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        chunks[i].progress = progress;
+        chunks[i].progressdata = data;
+        chunks[i].size = size;
+        begin = end;
+    }
+    
+    /* read in the vertices, normals, texcoords & triangles of all the
+       chunks at once (or a round of them at a time, passing on what
+       was read after each), then put them together */
+    if (stream) {
+        for (i = 0; i < 3; i++) {
+            batch.min[i] = (GLfloat)HUGE_VAL;
+            batch.max[i] = (GLfloat)-HUGE_VAL;
+        }
+        for (i = 0; i < numchunks; i += count) {
+            count = numchunks - i < numthreads ? numchunks - i : numthreads;
+            glmParallel(count, count, glmParseChunks, &chunks[i]);
+            glmStreamChunks(chunks, i, count, &batch, stream, data);
+        }
+    } else {
+        glmParallel(numchunks, numchunks, glmParseChunks, chunks);
+    }
+    glmMergeChunks(model, chunks, numchunks);
+    free(chunks);
+    
+    glmUnmapFile(file, size);
+    
+    return model;
+}
+
+/* glmFormatUint: writes n in decimal at p, returning the end */
+static char*
+glmFormatUint(char* p, GLuint n)
+{
+    char  digits[10];
+    int   i = 0;
+    
+    do {
+        digits[i++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n);
+    while (i)
+        *p++ = digits[--i];
+    return p;
+}
+
+/* glmFormatFloat: writes f at p exactly as printf's %f would (six
+ * decimals, rounded half to even from the exact binary value),
+ * without going through the locale dependent printf.  The value is
+ * m * 2^e, so m * 10^6 shifted by e is the answer in millionths;
+ * anything that doesn't fit in 64 bits that way (infinities, NaNs and
+ * numbers over 2^43 or so) is handed to sprintf instead.  Returns the
+ * end.
+ */
+static char*
+glmFormatFloat(char* p, GLfloat f)
+{
+    GLuint bits, exponent;
+    unsigned long long m, n, rest, half;
+    int    e;
+    char   digits[24];
+    int    i;
+    
+    memcpy(&bits, &f, sizeof(bits));
+    exponent = (bits >> 23) & 0xff;
+    m = bits & 0x7fffff;
+    if (exponent == 0) {
+        e = -149;
+    } else {
+        m |= 0x800000;
+        e = (int)exponent - 150;
+    }
+    if (exponent == 0xff || e > 19)
+        return p + sprintf(p, "%f", f);
+    
+    m *= 1000000;
+    if (e >= 0) {
+        n = m << e;
+    } else if (e < -62) {
+        n = 0;
+    } else {
+        n = m >> -e;
+        rest = m & ((1ULL << -e) - 1);
+        half = 1ULL << (-e - 1);
+        if (rest > half || (rest == half && (n & 1)))
+            n++;
+    }
+    
+    /* printf keeps the sign of numbers that round to zero */
+    if (bits >> 31)
+        *p++ = '-';
+    i = 0;
+    do {
+        digits[i++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n || i < 7);
+    while (i > 6)
+        *p++ = digits[--i];
+    *p++ = '.';
+    while (i)
+        *p++ = digits[--i];
+    return p;
+}
+
+/* lines of a model in each piece of an .OBJ file encoded at once */
+#ifndef GLM_WRITE_LINES
+#define GLM_WRITE_LINES (1 << 15)
+#endif
+
+/* most bytes any one line of an .OBJ file can take */
+#define GLM_WRITE_LINE 160
+
+/* GLMpiece: a run of lines of an .OBJ file being written, which is
+ * encoded into a buffer of its own on some thread and then written
+ * out in order.  head is text going in front of the lines (section
+ * comments, group and material names), tail puts a blank line after
+ * them.
+ */
+typedef struct _GLMpiece {
+    char      type;             /* 'v' vectors, 't' texcoords, 'f' faces */
+    const char* prefix;         /* of each vector: "v ", "vn " or "vt " */
+    GLfloat*  vectors;          /* the vectors (or texcoords) */
+    GLMgroup* group;            /* the faces */
+    GLuint    first;            /* first vector or triangle of the group */
+    GLuint    count;            /* number of lines */
+    char*     head;
+    GLboolean tail;
+    char*     buffer;           /* encoded piece */
+    size_t    length;
+} GLMpiece;
+
+/* GLMencoder: state shared by the threads encoding pieces of a file */
+typedef struct _GLMencoder {
+    GLMmodel* model;
+    GLuint    mode;
+    GLMpiece* pieces;
+} GLMencoder;
+
+/* glmEncodePieces: encodes pieces [begin, end), a GLMtask */
+static GLvoid
+glmEncodePieces(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMencoder* encoder = (GLMencoder*)data;
+    GLMmodel*   model = encoder->model;
+    GLuint      mode = encoder->mode;
+    GLMpiece*   piece;
+    GLMtriangle* triangle;
+    GLfloat*    v;
+    size_t      size;
+    GLuint      i, j;
+    char*       p;
+    
+    for (; begin < end; begin++) {
+        piece = &encoder->pieces[begin];
+        size = (size_t)piece->count * GLM_WRITE_LINE + 2;
+        if (piece->head)
+            size += strlen(piece->head);
+        p = piece->buffer = (char*)malloc(size);
+        
+        if (piece->head) {
+            strcpy(p, piece->head);
+            p += strlen(p);
+        }
+        
+        switch (piece->type) {
+        case 'v':
+            v = &piece->vectors[3 * piece->first];
+            for (i = 0; i < piece->count; i++, v += 3) {
+                for (j = 0; piece->prefix[j]; j++)
+                    *p++ = piece->prefix[j];
+                p = glmFormatFloat(p, v[0]);
+                *p++ = ' ';
+                p = glmFormatFloat(p, v[1]);
+                *p++ = ' ';
+                p = glmFormatFloat(p, v[2]);
+                *p++ = '\n';
+            }
+            break;
+            
+        case 't':
+            v = &piece->vectors[2 * piece->first];
+            for (i = 0; i < piece->count; i++, v += 2) {
+                *p++ = 'v';
+                *p++ = 't';
+                *p++ = ' ';
+                p = glmFormatFloat(p, v[0]);
+                *p++ = ' ';
+                p = glmFormatFloat(p, v[1]);
+                *p++ = '\n';
+            }
+            break;
+            
+        case 'f':
+            for (i = 0; i < piece->count; i++) {
+                triangle = &T(piece->group->triangles[piece->first + i]);
+                *p++ = 'f';
+                for (j = 0; j < 3; j++) {
+                    *p++ = ' ';
+                    p = glmFormatUint(p, triangle->vindices[j]);
+                    if (mode & GLM_TEXTURE) {
+                        *p++ = '/';
+                        p = glmFormatUint(p, triangle->tindices[j]);
+                    } else if (mode & (GLM_SMOOTH | GLM_FLAT)) {
+                        *p++ = '/';
+                    }
+                    if (mode & GLM_SMOOTH) {
+                        *p++ = '/';
+                        p = glmFormatUint(p, triangle->nindices[j]);
+                    } else if (mode & GLM_FLAT) {
+                        *p++ = '/';
+                        p = glmFormatUint(p, triangle->findex);
+                    }
+                }
+                *p++ = '\n';
+            }
+            break;
+        }
+        
+        if (piece->tail)
+            *p++ = '\n';
+        piece->length = p - piece->buffer;
+    }
+}
+
+/* glmAddPieces: splits count lines of one section of an .OBJ file into
+ * pieces at the end of the list, at least one (for the head) even if
+ * there are no lines.  Returns the first of them.
+ */
+static GLMpiece*
+glmAddPieces(GLMpiece** pieces, GLuint* numpieces, GLuint* capacity,
+             char type, GLuint count, char* head)
+{
+    GLMpiece* piece;
+    GLuint    start, first;
+    
+    start = *numpieces;
+    first = 0;
+    do {
+        *pieces = (GLMpiece*)glmGrow(*pieces, capacity, *numpieces + 1,
+            sizeof(GLMpiece));
+        piece = &(*pieces)[(*numpieces)++];
+        memset(piece, 0, sizeof(GLMpiece));
+        piece->type = type;
+        piece->first = first;
+        piece->count = count - first < GLM_WRITE_LINES ?
+            count - first : GLM_WRITE_LINES;
+        piece->head = first ? NULL : head;
+        first += piece->count;
+    } while (first < count);
+    
+    return *pieces + start;
+}
+
+/* glmSectionHead: returns a copy of a section comment for a piece */
+static char*
+glmSectionHead(const char* format, GLuint count)
+{
+    char buf[64];
+    
+    sprintf(buf, format, count);
+    return strdup(buf);
+}
+
+/* glmWriteOBJ: Writes a model description in Wavefront .OBJ format to
+ * a file.  All but the header is encoded in pieces, a number of them
+ * at once on the model's threads, and written out in order.
+ *
+ * model - initialized GLMmodel structure
+ * filename - name of the file to write the Wavefront .OBJ format data to
+ * mode  - a bitwise or of values describing what is written to the file
+ *             GLM_NONE     -  render with only vertices
+ *             GLM_FLAT     -  render with facet normals
+ *             GLM_SMOOTH   -  render with vertex normals
+ *             GLM_TEXTURE  -  render with texture coords
+ *             GLM_COLOR    -  render with colors (color material)
+ *             GLM_MATERIAL -  render with materials
+ *             GLM_COLOR and GLM_MATERIAL should not both be specified.  
+ *             GLM_FLAT and GLM_SMOOTH should not both be specified.  
+ */
+GLvoid
+glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode)
+{
+    GLuint  i, j;
+    FILE*   file;
+    GLMgroup* group;
+    GLMpiece* pieces;
+    GLMpiece* piece;
+    GLuint  numpieces, capacity, count, lines, numthreads;
+    GLMencoder encoder;
+    char    buf[64];
+    char*   head;
+    char*   p;
+    size_t  length;
+    
+    assert(model);
+    
+    /* do a bit of warning */
+    if (mode & GLM_FLAT && !model->facetnorms) {
+        printf("glmWriteOBJ() warning: flat normal output requested "
+            "with no facet normals defined.\n");
+        mode &= ~GLM_FLAT;
+    }
+    if (mode & GLM_SMOOTH && !model->normals) {
+        printf("glmWriteOBJ() warning: smooth normal output requested "
+            "with no normals defined.\n");
+        mode &= ~GLM_SMOOTH;
+    }
+    if (mode & GLM_TEXTURE && !model->texcoords) {
+        printf("glmWriteOBJ() warning: texture coordinate output requested "
+            "with no texture coordinates defined.\n");
+        mode &= ~GLM_TEXTURE;
+    }
+    if (mode & GLM_FLAT && mode & GLM_SMOOTH) {
+        printf("glmWriteOBJ() warning: flat normal output requested "
+            "and smooth normal output requested (using smooth).\n");
+        mode &= ~GLM_FLAT;
+    }
+    if (mode & GLM_COLOR && !model->materials) {
+        printf("glmWriteOBJ() warning: color output requested "
+            "with no colors (materials) defined.\n");
+        mode &= ~GLM_COLOR;
+    }
+    if (mode & GLM_MATERIAL && !model->materials) {
+        printf("glmWriteOBJ() warning: material output requested "
+            "with no materials defined.\n");
+        mode &= ~GLM_MATERIAL;
+    }
+    if (mode & GLM_COLOR && mode & GLM_MATERIAL) {
+        printf("glmWriteOBJ() warning: color and material output requested "
+            "outputting only materials.\n");
+        mode &= ~GLM_COLOR;
+    }
+    
+    
+    /* open the file */
+    file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "glmWriteOBJ() failed: can't open file \"%s\" to write.\n",
+            filename);
+        exit(1);
+    }
+    
+    /* spit out a header */
+    fprintf(file, "#  \n");
+    fprintf(file, "#  Wavefront OBJ generated by GLM library\n");
+    fprintf(file, "#  \n");
+    fprintf(file, "#  GLM library\n");
+    fprintf(file, "#  Nate Robins\n");
+    fprintf(file, "#  ndr@pobox.com\n");
+    fprintf(file, "#  http://www.pobox.com/~ndr\n");
+    fprintf(file, "#  \n");
+    
+    if (mode & GLM_MATERIAL && model->mtllibname) {
+        fprintf(file, "\nmtllib %s\n\n", model->mtllibname);
+        glmWriteMTL(model, filename, model->mtllibname);
+    }
+    
+    /* the rest goes in pieces, encoded a few at a time in parallel and
+       written in order */
+    pieces = NULL;
+    numpieces = capacity = 0;
+    
+    /* the vertices */
+    piece = glmAddPieces(&pieces, &numpieces, &capacity, 'v',
+        model->numvertices, glmSectionHead("\n# %u vertices\n",
+        model->numvertices));
+    for (; piece < pieces + numpieces; piece++) {
+        piece->prefix = "v ";
+        piece->vectors = model->vertices + 3;
+    }
+    
+    /* the smooth/flat normals */
+    if (mode & (GLM_SMOOTH | GLM_FLAT)) {
+        count = mode & GLM_SMOOTH ? model->numnormals : model->numfacetnorms;
+        piece = glmAddPieces(&pieces, &numpieces, &capacity, 'v', count,
+            glmSectionHead("\n# %u normals\n", count));
+        for (; piece < pieces + numpieces; piece++) {
+            piece->prefix = "vn ";
+            piece->vectors = (mode & GLM_SMOOTH ? model->normals :
+                model->facetnorms) + 3;
+        }
+    }
+    
+    /* the texture coordinates */
+    if (mode & GLM_TEXTURE) {
+        piece = glmAddPieces(&pieces, &numpieces, &capacity, 't',
+            model->numtexcoords, glmSectionHead("\n# %u texcoords\n",
+            model->numtexcoords));
+        for (; piece < pieces + numpieces; piece++)
+            piece->vectors = model->texcoords + 2;
+    }
+    
+    /* the faces, group by group */
+    sprintf(buf, "\n# %u groups\n# %u faces (triangles)\n\n",
+        model->numgroups, model->numtriangles);
+    for (group = model->groups; group; group = group->next) {
+        length = strlen(buf) + strlen(group->name) + 3;
+        if (mode & GLM_MATERIAL)
+            length += strlen(model->materials[group->material].name) + 8;
+        head = (char*)malloc(length + 1);
+        p = head + sprintf(head, "%sg %s\n", buf, group->name);
+        if (mode & GLM_MATERIAL)
+            sprintf(p, "usemtl %s\n", model->materials[group->material].name);
+        buf[0] = '\0';
+        
+        piece = glmAddPieces(&pieces, &numpieces, &capacity, 'f',
+            group->numtriangles, head);
+        for (; piece < pieces + numpieces; piece++)
+            piece->group = group;
+        pieces[numpieces - 1].tail = GL_TRUE;
+    }
+    if (buf[0])
+        fputs(buf, file);
+    
+    /* encode enough pieces at a time to keep every thread busy, then
+       write each out with one call */
+    encoder.model = model;
+    encoder.mode = mode;
+    numthreads = model->numthreads ? model->numthreads : glmProcessors();
+    for (i = 0; i < numpieces; i += count) {
+        lines = 0;
+        for (count = 0; i + count < numpieces &&
+             lines < numthreads * GLM_WRITE_LINES; count++)
+            lines += pieces[i + count].count + 1;
+        
+        encoder.pieces = pieces + i;
+        glmParallel(lines < GLM_WRITE_LINES ? 1 : numthreads, count,
+            glmEncodePieces, &encoder);
+        
+        for (j = i; j < i + count; j++) {
+            fwrite(pieces[j].buffer, 1, pieces[j].length, file);
+            free(pieces[j].buffer);
+            free(pieces[j].head);
+        }
+    }
+    free(pieces);
+    
+    fclose(file);
+}
+
+/* binary PLY and STL files */
+
+static GLuint glmCornerHash(GLuint v, GLuint n, GLuint t);
+
+/* glmLittleEndian: tells whether this machine is little endian */
+static GLboolean
+glmLittleEndian(GLvoid)
+{
+    GLuint one = 1;
+    
+    return *(unsigned char*)&one == 1;
+}
+
+/* glmSwapBytes: reverses the bytes of each of count values of size
+ * bytes at p.
+ */
+static GLvoid
+glmSwapBytes(GLvoid* p, size_t size, size_t count)
+{
+    unsigned char* b = (unsigned char*)p;
+    unsigned char  c;
+    size_t i, j;
+    
+    for (; count; count--, b += size) {
+        for (i = 0, j = size - 1; i < j; i++, j--) {
+            c = b[i];
+            b[i] = b[j];
+            b[j] = c;
+        }
+    }
+}
+
+/* glmDefaultGroup: puts all the triangles of a model (read from a
+ * file without groups) into a group named "default".
+ */
+static GLvoid
+glmDefaultGroup(GLMmodel* model)
+{
+    GLMgroup* group;
+    GLuint    i;
+    
+    group = glmAddGroup(model, "default");
+    group->numtriangles = model->numtriangles;
+    group->triangles = (GLuint*)glmAlloc(model->arena, 
+        sizeof(GLuint) * model->numtriangles);
+    for (i = 0; i < model->numtriangles; i++)
+        group->triangles[i] = i;
+}
+
+/* GLMplytype: a scalar type of PLY properties (which has two names) */
+typedef struct _GLMplytype {
+    const char* name;
+    const char* alias;
+    GLuint      size;
+} GLMplytype;
+
+static const GLMplytype glm_plytypes[] = {
+    { "char",   "int8",    1 },
+    { "uchar",  "uint8",   1 },
+    { "short",  "int16",   2 },
+    { "ushort", "uint16",  2 },
+    { "int",    "int32",   4 },
+    { "uint",   "uint32",  4 },
+    { "float",  "float32", 4 },
+    { "double", "float64", 8 }
+};
+#define GLM_PLY_TYPES  8        /* also marks a property that isn't a list */
+#define GLM_PLY_INT    4
+#define GLM_PLY_UINT   5
+#define GLM_PLY_FLOAT  6
+
+/* most elements and properties of each a PLY file may have */
+#define GLM_PLY_ELEMENTS   16
+#define GLM_PLY_PROPERTIES 64
+
+/* GLMplyproperty: a property of the elements of a PLY file */
+typedef struct _GLMplyproperty {
+    char    name[32];
+    GLuint  type;               /* of the value (or the items of a list) */
+    GLuint  counttype;          /* of the count of a list (or GLM_PLY_TYPES) */
+    GLuint  offset;             /* from the start of the element, if all
+                                   the properties before it are scalars */
+} GLMplyproperty;
+
+/* GLMplyelement: a kind of element of a PLY file ("vertex", "face") */
+typedef struct _GLMplyelement {
+    char    name[32];
+    GLuint  count;              /* number of them in the file */
+    GLuint  numproperties;
+    GLMplyproperty properties[GLM_PLY_PROPERTIES];
+    GLuint  size;               /* bytes in each, 0 if it has lists */
+    const char* data;           /* where the first one is */
+} GLMplyelement;
+
+/* GLMply: a PLY file being read, and state shared by the threads
+ * decoding its vertices and faces.
+ */
+typedef struct _GLMply {
+    GLMmodel*      model;
+    GLboolean      swap;        /* byte order isn't this machine's */
+    GLMplyelement* vertex;
+    GLMplyelement* face;
+    GLMplyproperty* position[3];  /* x, y and z */
+    GLMplyproperty* normal[3];    /* nx, ny and nz (or NULL) */
+    GLMplyproperty* texcoord[2];  /* u and v (or NULL) */
+    GLMplyproperty* indices;      /* vertex_indices list of the faces */
+    GLboolean      direct;      /* x, y and z are floats in a row that
+                                   can be copied as they are */
+} GLMply;
+
+/* glmPlyValue: returns the PLY scalar of the given type at p */
+static double
+glmPlyValue(const char* p, GLuint type, GLboolean swap)
+{
+    union {
+        signed char    c;
+        unsigned char  uc;
+        short          s;
+        unsigned short us;
+        int            i;
+        unsigned int   ui;
+        float          f;
+        double         d;
+        unsigned char  bytes[8];
+    } value;
+    
+    memcpy(value.bytes, p, glm_plytypes[type].size);
+    if (swap)
+        glmSwapBytes(value.bytes, glm_plytypes[type].size, 1);
+    
+    switch (type) {
+    case 0:  return value.c;
+    case 1:  return value.uc;
+    case 2:  return value.s;
+    case 3:  return value.us;
+    case 4:  return value.i;
+    case 5:  return value.ui;
+    case 6:  return value.f;
+    default: return value.d;
+    }
+}
+
+/* glmPlyIndex: returns the (1-based) vertex at the given (0-based)
+ * index in a face of a PLY file, or 0 if there is no such vertex.
+ */
+static GLuint
+glmPlyIndex(GLMply* ply, const char* p)
+{
+    GLuint type = ply->indices->type;
+    GLuint index;
+    double value;
+    
+    if ((type == GLM_PLY_INT || type == GLM_PLY_UINT) && !ply->swap) {
+        memcpy(&index, p, sizeof(GLuint));
+    } else {
+        value = glmPlyValue(p, type, ply->swap);
+        index = value >= 0 && value < 4294967295.0 ? (GLuint)value : (GLuint)-1;
+    }
+    
+    return index < ply->model->numvertices ? index + 1 : 0;
+}
+
+/* glmPlyFind: returns the property of an element with one of the
+ * given names (or NULL).
+ */
+static GLMplyproperty*
+glmPlyFind(GLMplyelement* element, const char* name, const char* alias)
+{
+    GLuint i;
+    
+    for (i = 0; element && i < element->numproperties; i++) {
+        if (!strcmp(element->properties[i].name, name) ||
+            (alias && !strcmp(element->properties[i].name, alias)))
+            return &element->properties[i];
+    }
+    return NULL;
+}
+
+/* glmPlyPropertySize: returns the bytes taken by a property (scalar
+ * or list) at p, or 0 if it would run past end.
+ */
+static size_t
+glmPlyPropertySize(GLMplyproperty* property, const char* p, const char* end,
+                   GLboolean swap)
+{
+    size_t size, countsize;
+    double count;
+    
+    size = glm_plytypes[property->type].size;
+    if (property->counttype == GLM_PLY_TYPES)
+        return (size_t)(end - p) >= size ? size : 0;
+    
+    countsize = glm_plytypes[property->counttype].size;
+    if ((size_t)(end - p) < countsize)
+        return 0;
+    count = glmPlyValue(p, property->counttype, swap);
+    if (count < 0 || count * size > (double)(end - p - countsize))
+        return 0;
+    
+    return countsize + (size_t)count * size;
+}
+
+/* glmPlySize: returns the bytes taken by the element at p, or 0 if it
+ * would run past end.
+ */
+static size_t
+glmPlySize(GLMplyelement* element, const char* p, const char* end,
+           GLboolean swap)
+{
+    const char* q;
+    size_t size;
+    GLuint i;
+    
+    if (element->size)
+        return (size_t)(end - p) >= element->size ? element->size : 0;
+    
+    q = p;
+    for (i = 0; i < element->numproperties; i++) {
+        size = glmPlyPropertySize(&element->properties[i], q, end, swap);
+        if (!size)
+            return 0;
+        q += size;
+    }
+    
+    return q - p;
+}
+
+/* glmPlyVertices: decodes vertices [begin, end) of a PLY file, a
+ * GLMtask.
+ */
+static GLvoid
+glmPlyVertices(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMply*    ply = (GLMply*)data;
+    GLMmodel*  model = ply->model;
+    GLMplyproperty* property;
+    const char* p;
+    GLuint     i, j;
+    
+    for (i = begin; i < end; i++) {
+        p = ply->vertex->data + (size_t)i * ply->vertex->size;
+        if (ply->direct) {
+            memcpy(&model->vertices[3 * (i + 1)], p + ply->position[0]->offset,
+                sizeof(GLfloat) * 3);
+        } else {
+            for (j = 0; j < 3; j++) {
+                property = ply->position[j];
+                model->vertices[3 * (i + 1) + j] = (GLfloat)glmPlyValue(
+                    p + property->offset, property->type, ply->swap);
+            }
+        }
+        for (j = 0; model->normals && j < 3; j++) {
+            property = ply->normal[j];
+            model->normals[3 * (i + 1) + j] = (GLfloat)glmPlyValue(
+                p + property->offset, property->type, ply->swap);
+        }
+        for (j = 0; model->texcoords && j < 2; j++) {
+            property = ply->texcoord[j];
+            model->texcoords[2 * (i + 1) + j] = (GLfloat)glmPlyValue(
+                p + property->offset, property->type, ply->swap);
+        }
+    }
+}
+
+/* glmPlyTriangle: sets the corners of a triangle to vertices a, b
+ * and c (the normals and texcoords, if any, go with the vertices).
+ */
+static GLvoid
+glmPlyTriangle(GLMmodel* model, GLMtriangle* triangle, GLuint a, GLuint b,
+               GLuint c)
+{
+    GLuint i;
+    
+    triangle->vindices[0] = a;
+    triangle->vindices[1] = b;
+    triangle->vindices[2] = c;
+    for (i = 0; i < 3; i++) {
+        triangle->nindices[i] = model->normals ? triangle->vindices[i] : 0;
+        triangle->tindices[i] = model->texcoords ? triangle->vindices[i] : 0;
+    }
+    triangle->findex = 0;
+}
+
+/* glmPlyTriangles: decodes faces [begin, end) of a PLY file whose
+ * faces are all triangles of the same size, a GLMtask.
+ */
+static GLvoid
+glmPlyTriangles(GLvoid* data, GLuint begin, GLuint end)
+{
+    GLMply*    ply = (GLMply*)data;
+    GLuint     size = glm_plytypes[ply->indices->type].size;
+    const char* p;
+    GLuint     i;
+    
+    for (i = begin; i < end; i++) {
+        p = ply->face->data + (size_t)i * ply->face->size + 
+            ply->indices->offset + glm_plytypes[ply->indices->counttype].size;
+        glmPlyTriangle(ply->model, &ply->model->triangles[i],
+            glmPlyIndex(ply, p), glmPlyIndex(ply, p + size),
+            glmPlyIndex(ply, p + 2 * size));
+    }
+}
+
+/* glmPlyFaces: walks through all the faces of a PLY file, splitting
+ * the ones with more than three corners into fans of triangles, and
+ * returns the number of triangles.  They are only counted if
+ * triangles is NULL.  Returns (GLuint)-1 if the faces run past end.
+ */
+static GLuint
+glmPlyFaces(GLMply* ply, const char* end, GLMtriangle* triangles)
+{
+    GLMplyelement*  face = ply->face;
+    GLMplyproperty* property;
+    GLuint     size = glm_plytypes[ply->indices->type].size;
+    GLuint     numtriangles, first, previous, count, i, j, k;
+    const char* p;
+    const char* q;
+    size_t     length;
+    
+    numtriangles = 0;
+    p = face->data;
+    for (i = 0; i < face->count; i++) {
+        for (j = 0; j < face->numproperties; j++) {
+            property = &face->properties[j];
+            length = glmPlyPropertySize(property, p, end, ply->swap);
+            if (!length)
+                return (GLuint)-1;
+            if (property == ply->indices) {
+                count = (GLuint)glmPlyValue(p, property->counttype, ply->swap);
+                q = p + glm_plytypes[property->counttype].size;
+                if (count >= 3 && triangles) {
+                    first = glmPlyIndex(ply, q);
+                    previous = glmPlyIndex(ply, q + size);
+                    for (k = 2; k < count; k++) {
+                        glmPlyTriangle(ply->model, &triangles[numtriangles],
+                            first, previous, glmPlyIndex(ply, q + k * size));
+                        previous = triangles[numtriangles++].vindices[2];
+                    }
+                } else if (count >= 3) {
+                    numtriangles += count - 2;
+                }
+            }
+            p += length;
+        }
+    }
+    
+    return numtriangles;
+}
+
+/* glmPlyType: returns the PLY scalar type with a name (or GLM_PLY_TYPES) */
+static GLuint
+glmPlyType(const char* name)
+{
+    GLuint i;
+    
+    for (i = 0; i < GLM_PLY_TYPES; i++) {
+        if (!strcmp(name, glm_plytypes[i].name) ||
+            !strcmp(name, glm_plytypes[i].alias))
+            break;
+    }
+    return i;
+}
+
+/* glmPlyHeader: reads the header of a PLY file into its elements,
+ * leaving the scanner where the data starts.  Returns what is wrong
+ * with the file, or NULL if it is a binary PLY file that can be read.
+ *
+ * s           - scanner at the start of the file
+ * elements    - room for GLM_PLY_ELEMENTS elements
+ * numelements - will contain the number of elements on return
+ * swap        - set if the byte order isn't this machine's
+ */
+static const char*
+glmPlyHeader(GLMscanner* s, GLMplyelement* elements, GLuint* numelements,
+             GLboolean* swap)
+{
+    GLMplyelement*  element;
+    GLMplyproperty* property;
+    const char* token;
+    size_t      length;
+    GLboolean   format;
+    GLint       count;
+    GLuint      offset, i, j;
+    char        buf[32];
+    
+    token = glmScanToken(s, &length);
+    if (!token || !glmIsToken(token, length, "ply"))
+        return "isn't a PLY file";
+    glmScanLine(s);
+    
+    *numelements = 0;
+    element = NULL;
+    format = GL_FALSE;
+    while (s->p < s->end) {
+        token = glmScanToken(s, &length);
+        if (!token) {
+            /* blank line */
+        } else if (glmIsToken(token, length, "format")) {
+            glmScanName(s, buf, sizeof(buf));
+            if (!strcmp(buf, "binary_little_endian"))
+                *swap = !glmLittleEndian();
+            else if (!strcmp(buf, "binary_big_endian"))
+                *swap = glmLittleEndian();
+            else
+                return "isn't a binary PLY file";
+            format = GL_TRUE;
+        } else if (glmIsToken(token, length, "element")) {
+            if (*numelements == GLM_PLY_ELEMENTS)
+                return "has too many kinds of elements";
+            element = &elements[(*numelements)++];
+            glmScanName(s, element->name, sizeof(element->name));
+            glmScanBlank(s);
+            if (!glmScanInt(s, &count) || count < 0)
+                return "has a bad element count";
+            element->count = count;
+            element->numproperties = 0;
+        } else if (glmIsToken(token, length, "property")) {
+            if (!element)
+                return "has a property outside of any element";
+            if (element->numproperties == GLM_PLY_PROPERTIES)
+                return "has too many properties";
+            property = &element->properties[element->numproperties++];
+            property->counttype = GLM_PLY_TYPES;
+            glmScanName(s, buf, sizeof(buf));
+            if (!strcmp(buf, "list")) {
+                property->counttype = glmPlyType(glmScanName(s, buf, sizeof(buf)));
+                if (property->counttype >= GLM_PLY_FLOAT)
+                    return "has a bad list count type";
+                glmScanName(s, buf, sizeof(buf));
+            }
+            property->type = glmPlyType(buf);
+            if (property->type == GLM_PLY_TYPES)
+                return "has a bad property type";
+            glmScanName(s, property->name, sizeof(property->name));
+        } else if (glmIsToken(token, length, "end_header")) {
+            glmScanLine(s);
+            if (!format)
+                return "has no format";
+            
+            /* the offsets of the properties up to the first list are
+               the same in every element, and so is the size of
+               elements without lists */
+            for (i = 0; i < *numelements; i++) {
+                element = &elements[i];
+                offset = 0;
+                for (j = 0; j < element->numproperties; j++) {
+                    property = &element->properties[j];
+                    property->offset = offset;
+                    if (property->counttype != GLM_PLY_TYPES)
+                        break;
+                    offset += glm_plytypes[property->type].size;
+                }
+                element->size = j == element->numproperties ? offset : 0;
+            }
+            return NULL;
+        }
+        
+        /* comment, obj_info and whatever else is ignored */
+        glmScanLine(s);
+    }
+    
+    return "has no end_header";
+}
+
+/* glmPlyStride: returns the size of each face of a PLY file if they
+ * are all triangles taking the same number of bytes (the vertex
+ * indices being their only list), or 0 otherwise.
+ */
+static GLuint
+glmPlyStride(GLMply* ply, const char* end)
+{
+    GLMplyelement*  face = ply->face;
+    GLMplyproperty* property;
+    GLuint stride, i;
+    
+    stride = 0;
+    for (i = 0; i < face->numproperties; i++) {
+        property = &face->properties[i];
+        if (property == ply->indices)
+            stride += glm_plytypes[property->counttype].size + 
+                3 * glm_plytypes[property->type].size;
+        else if (property->counttype == GLM_PLY_TYPES)
+            stride += glm_plytypes[property->type].size;
+        else
+            return 0;
+    }
+    
+    if (face->count > (size_t)(end - face->data) / stride)
+        return 0;
+    for (i = 0; i < face->count; i++) {
+        if (glmPlyValue(face->data + (size_t)i * stride + ply->indices->offset,
+            ply->indices->counttype, ply->swap) != 3)
+            return 0;
+    }
+    
+    return stride;
+}
+
+/* glmReadPLY: Reads a model from a binary (little or big endian) PLY
+ * file.  Returns a pointer to the created object which should be
+ * free'd with glmDelete().
+ *
+ * filename   - name of the file containing the PLY format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ */
+GLMmodel*
+glmReadPLY(char* filename, GLuint numthreads)
+{
+    GLMplyelement* elements;
+    GLMply      ply;
+    GLMscanner  s;
+    GLMmodel*   model;
+    const char* why;
+    const char* p;
+    char*       file;
+    size_t      size, length;
+    GLuint      numelements, stride, i, j;
+    
+    /* map the whole file into memory so it is read only once */
+    file = glmMapFile(filename, &size);
+    if (file == (char*)MAP_FAILED) {
+        fprintf(stderr, "glmReadPLY() failed: can't open data file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    
+    elements = (GLMplyelement*)malloc(sizeof(GLMplyelement) * GLM_PLY_ELEMENTS);
+    memset(&ply, 0, sizeof(ply));
+    s.p = file;
+    s.end = file + size;
+    why = glmPlyHeader(&s, elements, &numelements, &ply.swap);
+    
+    /* find where the vertices and faces start, stepping over any
+       elements before them */
+    p = s.p;
+    for (i = 0; !why && i < numelements; i++) {
+        elements[i].data = p;
+        if (!strcmp(elements[i].name, "vertex"))
+            ply.vertex = &elements[i];
+        else if (!strcmp(elements[i].name, "face"))
+            ply.face = &elements[i];
+        if (ply.vertex && ply.face)
+            break;
+        
+        if (elements[i].size) {
+            if (elements[i].count > (size_t)(s.end - p) / elements[i].size)
+                why = "is cut short";
+            else
+                p += (size_t)elements[i].count * elements[i].size;
+        } else {
+            for (j = 0; !why && j < elements[i].count; j++) {
+                length = glmPlySize(&elements[i], p, s.end, ply.swap);
+                if (!length)
+                    why = "is cut short";
+                p += length;
+            }
+        }
+    }
+    
+    if (!why && !ply.vertex)
+        why = "has no vertices";
+    if (!why && !ply.vertex->size)
+        why = "has vertices with lists";
+    if (!why) {
+        ply.position[0] = glmPlyFind(ply.vertex, "x", NULL);
+        ply.position[1] = glmPlyFind(ply.vertex, "y", NULL);
+        ply.position[2] = glmPlyFind(ply.vertex, "z", NULL);
+        if (!ply.position[0] || !ply.position[1] || !ply.position[2])
+            why = "has vertices without x, y and z";
+        else if (ply.vertex->count > (size_t)(s.end - ply.vertex->data) /
+            ply.vertex->size)
+            why = "is cut short";
+    }
+    if (!why && ply.face) {
+        ply.indices = glmPlyFind(ply.face, "vertex_indices", "vertex_index");
+        if (!ply.indices || ply.indices->counttype == GLM_PLY_TYPES)
+            why = "has faces without vertex indices";
+    }
+    if (why) {
+        fprintf(stderr, "glmReadPLY() failed: \"%s\" %s.\n", filename, why);
+        exit(1);
+    }
+    
+    /* normals and texcoords go with the vertices, if they have them */
+    ply.normal[0] = glmPlyFind(ply.vertex, "nx", NULL);
+    ply.normal[1] = glmPlyFind(ply.vertex, "ny", NULL);
+    ply.normal[2] = glmPlyFind(ply.vertex, "nz", NULL);
+    ply.texcoord[0] = glmPlyFind(ply.vertex, "u", "texture_u");
+    ply.texcoord[1] = glmPlyFind(ply.vertex, "v", "texture_v");
+    if (!ply.texcoord[0] || !ply.texcoord[1]) {
+        ply.texcoord[0] = glmPlyFind(ply.vertex, "s", "texture_s");
+        ply.texcoord[1] = glmPlyFind(ply.vertex, "t", "texture_t");
+    }
+    
+    model = glmEmptyModel(filename, numthreads);
+    ply.model = model;
+    model->numvertices = ply.vertex->count;
+    model->vertices = (GLfloat*)glmAlloc(model->arena, 
+        sizeof(GLfloat) * 3 * (model->numvertices + 1));
+    if (ply.normal[0] && ply.normal[1] && ply.normal[2]) {
+        model->numnormals = model->numvertices;
+        model->normals = (GLfloat*)glmAlloc(model->arena, 
+            sizeof(GLfloat) * 3 * (model->numnormals + 1));
+    }
+    if (ply.texcoord[0] && ply.texcoord[1]) {
+        model->numtexcoords = model->numvertices;
+        model->texcoords = (GLfloat*)glmAlloc(model->arena, 
+            sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
+    }
+    
+    /* positions that are floats in this machine's byte order are
+       copied as they are, all at once if that's all there is */
+    ply.direct = !ply.swap && 
+        ply.position[0]->type == GLM_PLY_FLOAT &&
+        ply.position[1]->type == GLM_PLY_FLOAT &&
+        ply.position[2]->type == GLM_PLY_FLOAT &&
+        ply.position[1]->offset == ply.position[0]->offset + 4 &&
+        ply.position[2]->offset == ply.position[0]->offset + 8;
+    if (ply.direct && ply.vertex->size == 3 * sizeof(GLfloat) &&
+        !model->normals && !model->texcoords) {
+        memcpy(model->vertices + 3, ply.vertex->data, 
+            sizeof(GLfloat) * 3 * model->numvertices);
+    } else {
+        glmParallel(model->numvertices < GLM_DECODE_GRAIN ? 1 : 
+            model->numthreads, model->numvertices, glmPlyVertices, &ply);
+    }
+    
+    /* faces that are all triangles of the same size are decoded in
+       parallel, anything else is walked through twice (to count the
+       triangles, then to make them) */
+    if (ply.face) {
+        stride = glmPlyStride(&ply, s.end);
+        if (stride) {
+            ply.face->size = stride;
+            model->numtriangles = ply.face->count;
+        } else {
+            model->numtriangles = glmPlyFaces(&ply, s.end, NULL);
+            if (model->numtriangles == (GLuint)-1) {
+                fprintf(stderr, "glmReadPLY() failed: \"%s\" is cut short.\n",
+                    filename);
+                exit(1);
+            }
+        }
+        model->triangles = (GLMtriangle*)glmAlloc(model->arena, 
+            sizeof(GLMtriangle) * (model->numtriangles + 1));
+        if (stride)
+            glmParallel(model->numtriangles < GLM_DECODE_GRAIN ? 1 : 
+                model->numthreads, model->numtriangles, glmPlyTriangles, &ply);
+        else
+            glmPlyFaces(&ply, s.end, model->triangles);
+    }
+    glmDefaultGroup(model);
+    
+    free(elements);
+    glmUnmapFile(file, size);
+    
+    return model;
+}
+
+/* bytes before the triangles of a binary STL file, and in each one */
+#define GLM_STL_HEADER   84
+#define GLM_STL_TRIANGLE 50
+
+/* glmReadSTL: Reads a model from a binary STL file.  Returns a
+ * pointer to the created object which should be free'd with
+ * glmDelete().
+ *
+ * filename   - name of the file containing the STL format data.
+ * numthreads - number of threads the model uses later (0 = one per
+ *              processor)
+ */
+GLMmodel*
+glmReadSTL(char* filename, GLuint numthreads)
+{
+    GLMmodel*    model;
+    GLMtriangle* triangle;
+    GLboolean    swap;
+    GLfloat  v[3];
+    GLuint   bits[3];
+    GLuint*  slots;
+    GLuint   count, mask, slot, i, j, k;
+    size_t   size;
+    char*    file;
+    const char* p;
+    
+    /* map the whole file into memory so it is read only once */
+    file = glmMapFile(filename, &size);
+    if (file == (char*)MAP_FAILED) {
+        fprintf(stderr, "glmReadSTL() failed: can't open data file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    
+    swap = !glmLittleEndian();
+    count = 0;
+    if (size >= GLM_STL_HEADER) {
+        memcpy(&count, file + GLM_STL_HEADER - 4, sizeof(count));
+        if (swap)
+            glmSwapBytes(&count, sizeof(count), 1);
+    }
+    if (size < GLM_STL_HEADER || 
+        (size - GLM_STL_HEADER) / GLM_STL_TRIANGLE < count) {
+        fprintf(stderr, "glmReadSTL() failed: \"%s\" isn't a binary STL file.\n",
+            filename);
+        exit(1);
+    }
+    
+    model = glmEmptyModel(filename, numthreads);
+    model->numtriangles = count;
+    model->triangles = (GLMtriangle*)glmAlloc(model->arena, 
+        sizeof(GLMtriangle) * (count + 1));
+    model->vertices = (GLfloat*)glmAlloc(model->arena, 
+        sizeof(GLfloat) * 3 * (3 * (size_t)count + 1));
+    
+    /* every corner has a vertex of its own in the file, so the ones
+       that are the same (bit for bit, but for the sign of zero) are
+       merged through a hash table of the vertices kept so far */
+    mask = 15;
+    while (mask < 6 * (size_t)count)
+        mask = 2 * mask + 1;
+    slots = (GLuint*)calloc((size_t)mask + 1, sizeof(GLuint));
+    
+    p = file + GLM_STL_HEADER;
+    for (i = 0; i < count; i++, p += GLM_STL_TRIANGLE) {
+        triangle = &model->triangles[i];
+        for (j = 0; j < 3; j++) {
+            memcpy(v, p + 12 * (j + 1), sizeof(v));
+            if (swap)
+                glmSwapBytes(v, sizeof(GLfloat), 3);
+            for (k = 0; k < 3; k++)
+                v[k] += 0.0f;
+            memcpy(bits, v, sizeof(bits));
+            
+            slot = glmCornerHash(bits[0], bits[1], bits[2]) & mask;
+            while (slots[slot] && memcmp(&model->vertices[3 * slots[slot]],
+                v, sizeof(v)))
+                slot = (slot + 1) & mask;
+            if (!slots[slot]) {
+                slots[slot] = ++model->numvertices;
+                memcpy(&model->vertices[3 * model->numvertices], v, sizeof(v));
+            }
+            
+            triangle->vindices[j] = slots[slot];
+            triangle->nindices[j] = 0;
+            triangle->tindices[j] = 0;
+        }
+        triangle->findex = 0;
+    }
+    free(slots);
+    
+    /* give back the room of the vertices that were merged */
+    model->vertices = (GLfloat*)glmRealloc(model->arena, model->vertices,
+        sizeof(GLfloat) * 3 * (model->numvertices + 1),
+        sizeof(GLfloat) * 3 * (model->numvertices + 1));
+    glmDefaultGroup(model);
+    
+    glmUnmapFile(file, size);
+    
+    return model;
+}
+
+/* glmWriteLittle: writes count values of size bytes to a file in
+ * little endian byte order (swapping them a buffer at a time on big
+ * endian machines).
+ */
+static GLvoid
+glmWriteLittle(FILE* file, const GLvoid* data, size_t size, size_t count)
+{
+    char   buf[1 << 16];
+    size_t n;
+    
+    if (glmLittleEndian()) {
+        fwrite(data, size, count, file);
+        return;
+    }
+    
+    for (; count; count -= n, data = (const char*)data + n * size) {
+        n = count < sizeof(buf) / size ? count : sizeof(buf) / size;
+        memcpy(buf, data, n * size);
+        glmSwapBytes(buf, size, n);
+        fwrite(buf, size, n, file);
+    }
+}
+
+/* glmWritePLY: Writes the vertices and triangles of a model to a
+ * binary (little endian) PLY file.
+ *
+ * model    - initialized GLMmodel structure
+ * filename - name of the file to write the PLY format data to
  */
 GLvoid
-glmScale(GLMmodel* model, GLfloat scale)
+glmWritePLY(GLMmodel* model, char* filename)
 {
-    GLuint i;
+    FILE*   file;
+    char*   buf;
+    char*   p;
+    GLint   indices[3];
+    GLuint  i, j, count;
     
-    for (i = 1; i <= model->numvertices; i++) {
-        model->vertices[3 * i + 0] *= scale;
-        model->vertices[3 * i + 1] *= scale;
-        model->vertices[3 * i + 2] *= scale;
+    assert(model);
+    
+    file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "glmWritePLY() failed: can't open file \"%s\" to write.\n",
+            filename);
+        exit(1);
+    }
+    
+    fprintf(file, "ply\n");
+    fprintf(file, "format binary_little_endian 1.0\n");
+    fprintf(file, "comment generated by GLM library\n");
+    fprintf(file, "element vertex %u\n", model->numvertices);
+    fprintf(file, "property float x\n");
+    fprintf(file, "property float y\n");
+    fprintf(file, "property float z\n");
+    fprintf(file, "element face %u\n", model->numtriangles);
+    fprintf(file, "property list uchar int vertex_indices\n");
+    fprintf(file, "end_header\n");
+    
+    glmWriteLittle(file, model->vertices + 3, sizeof(GLfloat), 
+        3 * model->numvertices);
+    
+    /* the faces go out GLM_WRITE_LINES at a time */
+    buf = (char*)malloc(13 * GLM_WRITE_LINES);
+    for (i = 0; i < model->numtriangles; i += count) {
+        count = model->numtriangles - i < GLM_WRITE_LINES ? 
+            model->numtriangles - i : GLM_WRITE_LINES;
+        for (j = 0, p = buf; j < count; j++, p += 13) {
+            indices[0] = T(i + j).vindices[0] - 1;
+            indices[1] = T(i + j).vindices[1] - 1;
+            indices[2] = T(i + j).vindices[2] - 1;
+            if (!glmLittleEndian())
+                glmSwapBytes(indices, sizeof(GLint), 3);
+            p[0] = 3;
+            memcpy(p + 1, indices, sizeof(indices));
+        }
+        fwrite(buf, 13, count, file);
     }
+    free(buf);
+    
+    fclose(file);
 }
 
-/* glmReverseWinding: Reverse the polygon winding for all polygons in
- * this model.   Default winding is counter-clockwise.  Also changes
- * the direction of the normals.
- * 
- * model - properly initialized GLMmodel structure 
+/* glmWriteSTL: Writes the triangles of a model to a binary STL file,
+ * with their facet normals (if the model has them).
+ *
+ * model    - initialized GLMmodel structure
+ * filename - name of the file to write the STL format data to
  */
 GLvoid
-glmReverseWinding(GLMmodel* model)
+glmWriteSTL(GLMmodel* model, char* filename)
 {
-    GLuint i, swap;
+    FILE*   file;
+    char*   buf;
+    char*   p;
+    GLfloat corners[12];
+    GLuint  i, j, count;
+    char    header[GLM_STL_HEADER];
     
     assert(model);
     
-    for (i = 0; i < model->numtriangles; i++) {
-        swap = T(i).vindices[0];
-        T(i).vindices[0] = T(i).vindices[2];
-        T(i).vindices[2] = swap;
-        
-        if (model->numnormals) {
-            swap = T(i).nindices[0];
-            T(i).nindices[0] = T(i).nindices[2];
-            T(i).nindices[2] = swap;
-        }
-        
-        if (model->numtexcoords) {
-            swap = T(i).tindices[0];
-            T(i).tindices[0] = T(i).tindices[2];
-            T(i).tindices[2] = swap;
-        }
+    file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "glmWriteSTL() failed: can't open file \"%s\" to write.\n",
+            filename);
+        exit(1);
     }
     
-    /* reverse facet normals */
-    for (i = 1; i <= model->numfacetnorms; i++) {
-        model->facetnorms[3 * i + 0] = -model->facetnorms[3 * i + 0];
-        model->facetnorms[3 * i + 1] = -model->facetnorms[3 * i + 1];
-        model->facetnorms[3 * i + 2] = -model->facetnorms[3 * i + 2];
-    }
+    /* the header mustn't start with "solid", or it looks like ASCII */
+    memset(header, 0, sizeof(header));
+    strcpy(header, "binary STL generated by GLM library");
+    memcpy(header + GLM_STL_HEADER - 4, &model->numtriangles, sizeof(GLuint));
+    if (!glmLittleEndian())
+        glmSwapBytes(header + GLM_STL_HEADER - 4, sizeof(GLuint), 1);
+    fwrite(header, 1, sizeof(header), file);
     
-    /* reverse vertex normals */
-    for (i = 1; i <= model->numnormals; i++) {
-        model->normals[3 * i + 0] = -model->normals[3 * i + 0];
-        model->normals[3 * i + 1] = -model->normals[3 * i + 1];
-        model->normals[3 * i + 2] = -model->normals[3 * i + 2];
+    /* the triangles go out GLM_WRITE_LINES at a time */
+    buf = (char*)malloc(GLM_STL_TRIANGLE * GLM_WRITE_LINES);
+    for (i = 0; i < model->numtriangles; i += count) {
+        count = model->numtriangles - i < GLM_WRITE_LINES ? 
+            model->numtriangles - i : GLM_WRITE_LINES;
+        for (j = 0, p = buf; j < count; j++, p += GLM_STL_TRIANGLE) {
+            if (model->facetnorms && T(i + j).findex)
+                memcpy(corners, &model->facetnorms[3 * T(i + j).findex],
+                    sizeof(GLfloat) * 3);
+            else
+                corners[0] = corners[1] = corners[2] = 0.0;
+            memcpy(corners + 3, &model->vertices[3 * T(i + j).vindices[0]],
+                sizeof(GLfloat) * 3);
+            memcpy(corners + 6, &model->vertices[3 * T(i + j).vindices[1]],
+                sizeof(GLfloat) * 3);
+            memcpy(corners + 9, &model->vertices[3 * T(i + j).vindices[2]],
+                sizeof(GLfloat) * 3);
+            if (!glmLittleEndian())
+                glmSwapBytes(corners, sizeof(GLfloat), 12);
+            memcpy(p, corners, sizeof(corners));
+            p[48] = p[49] = 0;
+        }
+        fwrite(buf, GLM_STL_TRIANGLE, count, file);
     }
+    free(buf);
+    
+    fclose(file);
 }
 
-/* glmFacetNormals: Generates facet normals for a model (by taking the
- * cross product of the two vectors derived from the sides of each
- * triangle).  Assumes a counter-clockwise winding.
+/* binary model cache (.glmb) */
+
+#define GLM_CACHE_MAGIC   "GLMB"
+#define GLM_CACHE_VERSION 1
+#define GLM_CACHE_ALIGN   16
+
+/* GLMBheader: start of a cache file.  Offsets are from the start of
+ * the file, 0 meaning the array isn't there.  Vector arrays include
+ * their unused element 0 so they can be used in place.
+ */
+typedef struct _GLMBheader {
+    char     magic[4];          /* GLM_CACHE_MAGIC */
+    GLuint   version;           /* GLM_CACHE_VERSION */
+    GLuint   byteorder;         /* 0x01020304 as written */
+    GLuint   headersize;        /* sizeof(GLMBheader) */
+    
+    unsigned long long size;    /* size of the source file */
+    long long mtime;            /* modification time of the source file */
+    unsigned long long path;    /* path of the source file (string) */
+    GLfloat  angle;             /* smoothing angle of the vertex normals */
+    GLfloat  scale;             /* scale factor the model was unitized with */
+    
+    GLfloat  position[3];
+    GLuint   numvertices;
+    GLuint   numnormals;
+    GLuint   numtexcoords;
+    GLuint   numfacetnorms;
+    GLuint   numtriangles;
+    GLuint   nummaterials;
+    GLuint   numgroups;
+    unsigned long long mtllibname;  /* (string) */
+    unsigned long long vertices;
+    unsigned long long normals;
+    unsigned long long texcoords;
+    unsigned long long facetnorms;
+    unsigned long long triangles;
+    unsigned long long materials;   /* array of GLMBmaterial */
+    unsigned long long groups;      /* array of GLMBgroup in list order */
+} GLMBheader;
+
+/* GLMBmaterial: a material in a cache file */
+typedef struct _GLMBmaterial {
+    unsigned long long name;    /* (string) */
+    GLfloat  diffuse[4];
+    GLfloat  ambient[4];
+    GLfloat  specular[4];
+    GLfloat  emmissive[4];
+    GLfloat  shininess;
+    GLuint   pad;
+} GLMBmaterial;
+
+/* GLMBgroup: a group in a cache file */
+typedef struct _GLMBgroup {
+    unsigned long long name;        /* (string) */
+    unsigned long long triangles;   /* array of numtriangles GLuints */
+    GLuint   numtriangles;
+    GLuint   material;
+} GLMBgroup;
+
+/* glmCacheName: returns the name of the cache file of a Wavefront OBJ
+ * file: its .obj extension replaced by .glmb (or .glmb appended).
  *
- * model - initialized GLMmodel structure
+ * NOTE: the return value should be free'd.
  */
-GLvoid
-glmFacetNormals(GLMmodel* model)
+static char*
+glmCacheName(char* filename)
 {
-    GLuint  i;
-    GLfloat u[3];
-    GLfloat v[3];
+    char* name;
+    char* ext;
     
-    assert(model);
-    assert(model->vertices);
+    name = (char*)malloc(strlen(filename) + 6);
+    strcpy(name, filename);
+    ext = strrchr(name, '.');
+    if (ext && !strchr(ext, '/') && !strchr(ext, '\\'))
+        *ext = '\0';
+    strcat(name, ".glmb");
     
-    /* clobber any old facetnormals */
-    if (model->facetnorms)
-        free(model->facetnorms);
+    return name;
+}
+
+/* glmCacheWrite: appends data to a cache file being written at offset
+ * *end, padded to GLM_CACHE_ALIGN.  Returns the offset it went to (or
+ * 0 when there is no data).
+ */
+static unsigned long long
+glmCacheWrite(FILE* file, unsigned long long* end, const GLvoid* data,
+              size_t size)
+{
+    static const char zeros[GLM_CACHE_ALIGN];
+    unsigned long long offset;
     
-    /* allocate memory for the new facet normals */
-    model->numfacetnorms = model->numtriangles;
-    model->facetnorms = (GLfloat*)malloc(sizeof(GLfloat) *
-                       3 * (model->numfacetnorms + 1));
+    if (!data || !size)
+        return 0;
     
-    for (i = 0; i < model->numtriangles; i++) {
-        model->triangles[i].findex = i+1;
-        
-        u[0] = model->vertices[3 * T(i).vindices[1] + 0] -
-            model->vertices[3 * T(i).vindices[0] + 0];
-        u[1] = model->vertices[3 * T(i).vindices[1] + 1] -
-            model->vertices[3 * T(i).vindices[0] + 1];
-        u[2] = model->vertices[3 * T(i).vindices[1] + 2] -
-            model->vertices[3 * T(i).vindices[0] + 2];
-        
-        v[0] = model->vertices[3 * T(i).vindices[2] + 0] -
-            model->vertices[3 * T(i).vindices[0] + 0];
-        v[1] = model->vertices[3 * T(i).vindices[2] + 1] -
-            model->vertices[3 * T(i).vindices[0] + 1];
-        v[2] = model->vertices[3 * T(i).vindices[2] + 2] -
-            model->vertices[3 * T(i).vindices[0] + 2];
-        
-        glmCross(u, v, &model->facetnorms[3 * (i+1)]);
-        glmNormalize(&model->facetnorms[3 * (i+1)]);
+    offset = *end;
+    fwrite(data, 1, size, file);
+    *end += size;
+    if (*end % GLM_CACHE_ALIGN) {
+        fwrite(zeros, 1, GLM_CACHE_ALIGN - *end % GLM_CACHE_ALIGN, file);
+        *end += GLM_CACHE_ALIGN - *end % GLM_CACHE_ALIGN;
     }
+    
+    return offset;
 }
 
-/* glmVertexNormals: Generates smooth vertex normals for a model.
- * First builds a list of all the triangles each vertex is in.   Then
- * loops through each vertex in the the list averaging all the facet
- * normals of the triangles each vertex is in.   Finally, sets the
- * normal index in the triangle for the vertex to the generated smooth
- * normal.   If the dot product of a facet normal and the facet normal
- * associated with the first triangle in the list of triangles the
- * current vertex is in is greater than the cosine of the angle
- * parameter to the function, that facet normal is not added into the
- * average normal calculation and the corresponding vertex is given
- * the facet normal.  This tends to preserve hard edges.  The angle to
- * use depends on the model, but 90 degrees is usually a good start.
+/* glmCacheVectors: like glmCacheWrite, for a 1-based vector array whose
+ * unused element 0 is written out as zeros.
+ */
+static unsigned long long
+glmCacheVectors(FILE* file, unsigned long long* end, const GLfloat* vectors,
+                GLuint count, GLuint components)
+{
+    static const GLfloat zeros[4];
+    unsigned long long offset;
+    
+    if (!vectors)
+        return 0;
+    
+    offset = *end;
+    fwrite(zeros, sizeof(GLfloat), components, file);
+    *end += sizeof(GLfloat) * components;
+    glmCacheWrite(file, end, &vectors[components], 
+        sizeof(GLfloat) * components * count);
+    
+    /* an empty array still gets its element 0 */
+    if (!count && *end % GLM_CACHE_ALIGN) {
+        fwrite(zeros, 1, GLM_CACHE_ALIGN - *end % GLM_CACHE_ALIGN, file);
+        *end += GLM_CACHE_ALIGN - *end % GLM_CACHE_ALIGN;
+    }
+    
+    return offset;
+}
+
+/* glmCacheString: like glmCacheWrite, for a NUL terminated string */
+static unsigned long long
+glmCacheString(FILE* file, unsigned long long* end, const char* string)
+{
+    if (!string)
+        return 0;
+    return glmCacheWrite(file, end, string, strlen(string) + 1);
+}
+
+/* glmWriteCache: Writes a (fully processed) model into the binary
+ * cache file next to the Wavefront .OBJ file it was read from, so that
+ * glmReadCache() can map it back in without parsing anything.  The
+ * cache is keyed by the path, size and modification time of the OBJ
+ * file, and by the smoothing angle its vertex normals were made with.
  *
  * model - initialized GLMmodel structure
- * angle - maximum angle (in degrees) to smooth across
+ * angle - smoothing angle glmVertexNormals() was called with
+ * scale - scale factor glmUnitize() returned (or 1.0)
  */
 GLvoid
-glmVertexNormals(GLMmodel* model, GLfloat angle)
+glmWriteCache(GLMmodel* model, GLfloat angle, GLfloat scale)
 {
-    GLMnode*    node;
-    GLMnode*    tail;
-    GLMnode** members;
-    GLfloat*    normals;
-    GLuint  numnormals;
-    GLfloat average[3];
-    GLfloat dot, cos_angle;
-    GLuint  i, avg;
+    GLMBheader    header;
+    GLMBmaterial* materials;
+    GLMBgroup*    groups;
+    GLMgroup*     group;
+    struct stat   info;
+    unsigned long long end;
+    char*  filename;
+    char*  tempname;
+    FILE*  file;
+    GLuint i;
     
     assert(model);
-    assert(model->facetnorms);
     
-    /* calculate the cosine of the angle (in degrees) */
-    cos_angle = cos(angle * M_PI / 180.0);
+    if (stat(model->pathname, &info) < 0)
+        return;
     
-    /* nuke any previous normals */
-    if (model->normals)
-        free(model->normals);
+    filename = glmCacheName(model->pathname);
+    tempname = (char*)malloc(strlen(filename) + 2);
+    strcpy(tempname, filename);
+    strcat(tempname, "~");
+    
+    /* a missing cache isn't an error, so just skip it if the directory
+       isn't writable */
+    file = fopen(tempname, "wb");
+    if (!file) {
+        free(tempname);
+        free(filename);
+        return;
+    }
     
-    /* allocate space for new normals */
-    model->numnormals = model->numtriangles * 3; /* 3 normals per triangle */
-    model->normals = (GLfloat*)malloc(sizeof(GLfloat)* 3* (model->numnormals+1));
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GLM_CACHE_MAGIC, 4);
+    header.version = GLM_CACHE_VERSION;
+    header.byteorder = 0x01020304;
+    header.headersize = sizeof(GLMBheader);
+    header.size = info.st_size;
+    header.mtime = info.st_mtime;
+    header.angle = angle;
+    header.scale = scale;
+    header.position[0] = model->position[0];
+    header.position[1] = model->position[1];
+    header.position[2] = model->position[2];
+    header.numvertices = model->numvertices;
+    header.numnormals = model->numnormals;
+    header.numtexcoords = model->numtexcoords;
+    header.numfacetnorms = model->numfacetnorms;
+    header.numtriangles = model->numtriangles;
+    header.nummaterials = model->nummaterials;
+    header.numgroups = model->numgroups;
     
-    /* allocate a structure that will hold a linked list of triangle
-    indices for each vertex */
-    members = (GLMnode**)malloc(sizeof(GLMnode*) * (model->numvertices + 1));
-    for (i = 1; i <= model->numvertices; i++)
-        members[i] = NULL;
+    /* the header goes in last, once all the offsets are known */
+    end = 0;
+    glmCacheWrite(file, &end, &header, sizeof(header));
     
-    /* for every triangle, create a node for each vertex in it */
-    for (i = 0; i < model->numtriangles; i++) {
-        node = (GLMnode*)malloc(sizeof(GLMnode));
-        node->index = i;
-        node->next  = members[T(i).vindices[0]];
-        members[T(i).vindices[0]] = node;
-        
-        node = (GLMnode*)malloc(sizeof(GLMnode));
-        node->index = i;
-        node->next  = members[T(i).vindices[1]];
-        members[T(i).vindices[1]] = node;
-        
-        node = (GLMnode*)malloc(sizeof(GLMnode));
-        node->index = i;
-        node->next  = members[T(i).vindices[2]];
-        members[T(i).vindices[2]] = node;
+    header.path = glmCacheString(file, &end, model->pathname);
+    header.mtllibname = glmCacheString(file, &end, model->mtllibname);
+    header.vertices = glmCacheVectors(file, &end, model->vertices,
+        model->numvertices, 3);
+    header.normals = glmCacheVectors(file, &end, model->normals,
+        model->numnormals, 3);
+    header.texcoords = glmCacheVectors(file, &end, model->texcoords,
+        model->numtexcoords, 2);
+    header.facetnorms = glmCacheVectors(file, &end, model->facetnorms,
+        model->numfacetnorms, 3);
+    header.triangles = glmCacheWrite(file, &end, model->triangles,
+        sizeof(GLMtriangle) * model->numtriangles);
+    
+    materials = (GLMBmaterial*)calloc(model->nummaterials + 1, 
+        sizeof(GLMBmaterial));
+    for (i = 0; i < model->nummaterials; i++) {
+        materials[i].name = glmCacheString(file, &end, 
+            model->materials[i].name);
+        memcpy(materials[i].diffuse, model->materials[i].diffuse, 
+            sizeof(GLfloat) * 4);
+        memcpy(materials[i].ambient, model->materials[i].ambient, 
+            sizeof(GLfloat) * 4);
+        memcpy(materials[i].specular, model->materials[i].specular, 
+            sizeof(GLfloat) * 4);
+        memcpy(materials[i].emmissive, model->materials[i].emmissive, 
+            sizeof(GLfloat) * 4);
+        materials[i].shininess = model->materials[i].shininess;
     }
+    header.materials = glmCacheWrite(file, &end, materials, 
+        sizeof(GLMBmaterial) * model->nummaterials);
+    free(materials);
     
-    /* calculate the average normal for each vertex */
-    numnormals = 1;
-    for (i = 1; i <= model->numvertices; i++) {
-    /* calculate an average normal for this vertex by averaging the
-        facet normal of every triangle this vertex is in */
-        node = members[i];
-        if (!node)
-            fprintf(stderr, "glmVertexNormals(): vertex w/o a triangle\n");
-        average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
-        avg = 0;
-        while (node) {
-        /* only average if the dot product of the angle between the two
-        facet normals is greater than the cosine of the threshold
-        angle -- or, said another way, the angle between the two
-            facet normals is less than (or equal to) the threshold angle */
-            dot = glmDot(&model->facetnorms[3 * T(node->index).findex],
-                &model->facetnorms[3 * T(members[i]->index).findex]);
-            if (dot > cos_angle) {
-                node->averaged = GL_TRUE;
-                average[0] += model->facetnorms[3 * T(node->index).findex + 0];
-                average[1] += model->facetnorms[3 * T(node->index).findex + 1];
-                average[2] += model->facetnorms[3 * T(node->index).findex + 2];
-                avg = 1;            /* we averaged at least one normal! */
-            } else {
-                node->averaged = GL_FALSE;
-            }
-            node = node->next;
-        }
-        
-        if (avg) {
-            /* normalize the averaged normal */
-            glmNormalize(average);
-            
-            /* add the normal to the vertex normals list */
-            model->normals[3 * numnormals + 0] = average[0];
-            model->normals[3 * numnormals + 1] = average[1];
-            model->normals[3 * numnormals + 2] = average[2];
-            avg = numnormals;
-            numnormals++;
-        }
+    groups = (GLMBgroup*)calloc(model->numgroups + 1, sizeof(GLMBgroup));
+    for (group = model->groups, i = 0; group; group = group->next, i++) {
+        groups[i].name = glmCacheString(file, &end, group->name);
+        groups[i].triangles = glmCacheWrite(file, &end, group->triangles,
+            sizeof(GLuint) * group->numtriangles);
+        groups[i].numtriangles = group->numtriangles;
+        groups[i].material = group->material;
+    }
+    header.groups = glmCacheWrite(file, &end, groups, 
+        sizeof(GLMBgroup) * model->numgroups);
+    free(groups);
+    
+    rewind(file);
+    fwrite(&header, sizeof(header), 1, file);
+    if (fclose(file) == 0) {
+        /* only a complete cache file takes the place of the old one */
+        remove(filename);
+        rename(tempname, filename);
+    } else {
+        remove(tempname);
+    }
+    
+    free(tempname);
+    free(filename);
+}
+
+/* glmReadCache: Reads a model from the binary cache file written by
+ * glmWriteCache() next to a Wavefront .OBJ file.  The cache file is
+ * memory mapped copy-on-write and the model's arrays point right into
+ * it, so nothing is copied or parsed.  Returns NULL if there is no
+ * cache, or it is stale (the OBJ file or the smoothing angle changed);
+ * otherwise the model should be free'd with glmDelete() as usual.
+ *
+ * filename - name of the Wavefront .OBJ file
+ * angle    - smoothing angle the vertex normals should be made with
+ * scale    - will contain the scale factor the model was unitized with
+ */
+GLMmodel*
+glmReadCache(char* filename, GLfloat angle, GLfloat* scale)
+{
+    GLMmodel*     model;
+    GLMBheader*   header;
+    GLMBmaterial* materials;
+    GLMBgroup*    groups;
+    GLMgroup*     group;
+    GLMgroup**    tail;
+    struct stat   info;
+    char*  cachename;
+    char*  base;
+    size_t size;
+    GLuint i;
+    int    fd;
+    
+    if (stat(filename, &info) < 0)
+        return NULL;
+    
+    cachename = glmCacheName(filename);
+    fd = open(cachename, O_RDONLY | O_BINARY);
+    free(cachename);
+    if (fd < 0)
+        return NULL;
+    
+    base = NULL;
+    size = 0;
+    header = NULL;
+    {
+        struct stat cacheinfo;
         
-        /* set the normal of this vertex in each triangle it is in */
-        node = members[i];
-        while (node) {
-            if (node->averaged) {
-                /* if this node was averaged, use the average normal */
-                if (T(node->index).vindices[0] == i)
-                    T(node->index).nindices[0] = avg;
-                else if (T(node->index).vindices[1] == i)
-                    T(node->index).nindices[1] = avg;
-                else if (T(node->index).vindices[2] == i)
-                    T(node->index).nindices[2] = avg;
-            } else {
-                /* if this node wasn't averaged, use the facet normal */
-                model->normals[3 * numnormals + 0] = 
-                    model->facetnorms[3 * T(node->index).findex + 0];
-                model->normals[3 * numnormals + 1] = 
-                    model->facetnorms[3 * T(node->index).findex + 1];
-                model->normals[3 * numnormals + 2] = 
-                    model->facetnorms[3 * T(node->index).findex + 2];
-                if (T(node->index).vindices[0] == i)
-                    T(node->index).nindices[0] = numnormals;
-                else if (T(node->index).vindices[1] == i)
-                    T(node->index).nindices[1] = numnormals;
-                else if (T(node->index).vindices[2] == i)
-                    T(node->index).nindices[2] = numnormals;
-                numnormals++;
-            }
-            node = node->next;
+        if (fstat(fd, &cacheinfo) == 0 && 
+            cacheinfo.st_size >= (off_t)sizeof(GLMBheader)) {
+            size = cacheinfo.st_size;
+            base = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, 
+                MAP_PRIVATE, fd, 0);
+            if (base == (char*)MAP_FAILED)
+                base = NULL;
         }
     }
+    close(fd);
+    if (!base)
+        return NULL;
     
-    model->numnormals = numnormals - 1;
+    /* make sure the cache is ours and up to date */
+    header = (GLMBheader*)base;
+    if (memcmp(header->magic, GLM_CACHE_MAGIC, 4) ||
+        header->version != GLM_CACHE_VERSION ||
+        header->byteorder != 0x01020304 ||
+        header->headersize != sizeof(GLMBheader) ||
+        header->size != (unsigned long long)info.st_size ||
+        header->mtime != (long long)info.st_mtime ||
+        header->angle != angle ||
+        !header->path || header->path >= size ||
+        strcmp(base + header->path, filename)) {
+        munmap(base, size);
+        return NULL;
+    }
     
-    /* free the member information */
-    for (i = 1; i <= model->numvertices; i++) {
-        node = members[i];
-        while (node) {
-            tail = node;
-            node = node->next;
-            free(tail);
+    model = glmNewModel();
+    model->pathname      = glmStrdup(model->arena, filename);
+    model->mtllibname    = header->mtllibname ? base + header->mtllibname : NULL;
+    model->numvertices   = header->numvertices;
+    model->vertices      = (GLfloat*)(base + header->vertices);
+    model->numnormals    = header->numnormals;
+    model->normals       = header->normals ? 
+        (GLfloat*)(base + header->normals) : NULL;
+    model->numtexcoords  = header->numtexcoords;
+    model->texcoords     = header->texcoords ? 
+        (GLfloat*)(base + header->texcoords) : NULL;
+    model->numfacetnorms = header->numfacetnorms;
+    model->facetnorms    = header->facetnorms ? 
+        (GLfloat*)(base + header->facetnorms) : NULL;
+    model->numtriangles  = header->numtriangles;
+    model->triangles     = header->triangles ? 
+        (GLMtriangle*)(base + header->triangles) : NULL;
+    model->nummaterials  = header->nummaterials;
+    model->materials     = NULL;
+    model->numgroups     = header->numgroups;
+    model->groups        = NULL;
+    model->grouparray    = NULL;
+    model->grouphash     = NULL;
+    model->grouphashsize = 0;
+    model->materialhash  = NULL;
+    model->materialhashsize = 0;
+    model->smoothing     = NULL;
+    model->position[0]   = header->position[0];
+    model->position[1]   = header->position[1];
+    model->position[2]   = header->position[2];
+    model->numthreads    = 0;
+    model->mapping       = base;
+    model->mappingsize   = size;
+    
+    /* the (small) material and group structures have pointers in them,
+       so those are rebuilt around the mapped names and arrays */
+    if (model->nummaterials) {
+        materials = (GLMBmaterial*)(base + header->materials);
+        model->materials = (GLMmaterial*)glmAlloc(model->arena, 
+            sizeof(GLMmaterial) * model->nummaterials);
+        for (i = 0; i < model->nummaterials; i++) {
+            model->materials[i].name = base + materials[i].name;
+            memcpy(model->materials[i].diffuse, materials[i].diffuse,
+                sizeof(GLfloat) * 4);
+            memcpy(model->materials[i].ambient, materials[i].ambient,
+                sizeof(GLfloat) * 4);
+            memcpy(model->materials[i].specular, materials[i].specular,
+                sizeof(GLfloat) * 4);
+            memcpy(model->materials[i].emmissive, materials[i].emmissive,
+                sizeof(GLfloat) * 4);
+            model->materials[i].shininess = materials[i].shininess;
         }
     }
-    free(members);
     
-    /* pack the normals array (we previously allocated the maximum
-    number of normals that could possibly be created (numtriangles *
-    3), so get rid of some of them (usually alot unless none of the
-    facet normals were averaged)) */
-    normals = model->normals;
-    model->normals = (GLfloat*)malloc(sizeof(GLfloat)* 3* (model->numnormals+1));
-    for (i = 1; i <= model->numnormals; i++) {
-        model->normals[3 * i + 0] = normals[3 * i + 0];
-        model->normals[3 * i + 1] = normals[3 * i + 1];
-        model->normals[3 * i + 2] = normals[3 * i + 2];
+    groups = (GLMBgroup*)(base + header->groups);
+    tail = &model->groups;
+    for (i = 0; i < model->numgroups; i++) {
+        group = (GLMgroup*)glmAlloc(model->arena, sizeof(GLMgroup));
+        group->name = base + groups[i].name;
+        group->numtriangles = groups[i].numtriangles;
+        group->triangles = (GLuint*)(base + groups[i].triangles);
+        group->material = groups[i].material;
+        group->next = NULL;
+        *tail = group;
+        tail = &group->next;
     }
-    free(normals);
+    glmIndexGroups(model);
+    glmIndexMaterials(model);
+    
+    if (scale)
+        *scale = header->scale;
+    
+    return model;
 }
 
 
-/* glmLinearTexture: Generates texture coordinates according to a
- * linear projection of the texture map.  It generates these by
- * linearly mapping the vertices onto a square.
+/* glmCheckArrays: Returns the render mode (see glmDraw()) without the
+ * parts that can't be rendered with the arrays given, warning about
+ * each.
+ */
+static GLuint
+glmCheckArrays(GLfloat* facetnorms, GLfloat* normals, GLfloat* texcoords,
+               GLMmaterial* materials, GLuint mode)
+{
+    /* do a bit of warning */
+    if (mode & GLM_FLAT && !facetnorms) {
+        printf("glmDraw() warning: flat render mode requested "
+            "with no facet normals defined.\n");
+        mode &= ~GLM_FLAT;
+    }
+    if (mode & GLM_SMOOTH && !normals) {
+        printf("glmDraw() warning: smooth render mode requested "
+            "with no normals defined.\n");
+        mode &= ~GLM_SMOOTH;
+    }
+    if (mode & GLM_TEXTURE && !texcoords) {
+        printf("glmDraw() warning: texture render mode requested "
+            "with no texture coordinates defined.\n");
+        mode &= ~GLM_TEXTURE;
+    }
+    if (mode & GLM_FLAT && mode & GLM_SMOOTH) {
+        printf("glmDraw() warning: flat render mode requested "
+            "and smooth render mode requested (using smooth).\n");
+        mode &= ~GLM_FLAT;
+    }
+    if (mode & GLM_COLOR && !materials) {
+        printf("glmDraw() warning: color render mode requested "
+            "with no materials defined.\n");
+        mode &= ~GLM_COLOR;
+    }
+    if (mode & GLM_MATERIAL && !materials) {
+        printf("glmDraw() warning: material render mode requested "
+            "with no materials defined.\n");
+        mode &= ~GLM_MATERIAL;
+    }
+    if (mode & GLM_COLOR && mode & GLM_MATERIAL) {
+        printf("glmDraw() warning: color and material render mode requested "
+            "using only material mode.\n");
+        mode &= ~GLM_COLOR;
+    }
+    
+    return mode;
+}
+
+/* glmCheckMode: Returns the render mode (see glmDraw()) without the
+ * parts the model can't be rendered with, warning about each.
+ */
+static GLuint
+glmCheckMode(GLMmodel* model, GLuint mode)
+{
+    return glmCheckArrays(model->facetnorms, model->normals, 
+        model->texcoords, model->materials, mode);
+}
+
+/* glmSortGroups: Returns the groups of the model that have triangles
+ * (in a NULL terminated array that should be free'd), in the order
+ * they are best drawn in with the mode specified: by material when
+ * rendering with colors or materials, otherwise as they are listed.
+ * The sort is stable, so groups sharing a material stay in list order.
+ *
+ * model    - initialized GLMmodel structure
+ * mode     - render mode (see glmDraw())
+ */
+static GLMgroup**
+glmSortGroups(GLMmodel* model, GLuint mode)
+{
+    GLMgroup** groups;
+    GLMgroup*  group;
+    GLuint*    starts;
+    GLuint     numgroups, i;
+    
+    numgroups = 0;
+    for (group = model->groups; group; group = group->next)
+        if (group->numtriangles)
+            numgroups++;
+    groups = (GLMgroup**)malloc(sizeof(GLMgroup*) * (numgroups + 1));
+    groups[numgroups] = NULL;
+    
+    if (!(mode & (GLM_COLOR | GLM_MATERIAL)) || !model->nummaterials) {
+        i = 0;
+        for (group = model->groups; group; group = group->next)
+            if (group->numtriangles)
+                groups[i++] = group;
+        return groups;
+    }
+    
+    /* counting sort on the material index */
+    starts = (GLuint*)calloc(model->nummaterials + 1, sizeof(GLuint));
+    for (group = model->groups; group; group = group->next)
+        if (group->numtriangles)
+            starts[group->material + 1]++;
+    for (i = 0; i < model->nummaterials; i++)
+        starts[i + 1] += starts[i];
+    for (group = model->groups; group; group = group->next)
+        if (group->numtriangles)
+            groups[starts[group->material]++] = group;
+    free(starts);
+    
+    return groups;
+}
+
+/* glmSameMaterial: returns GL_TRUE if two materials look the same when
+ * rendered in the mode specified, so switching between them can be
+ * skipped.
+ */
+static GLboolean
+glmSameMaterial(GLMmaterial* a, GLMmaterial* b, GLuint mode)
+{
+    if (a == b)
+        return GL_TRUE;
+    if (mode & GLM_MATERIAL)
+        return !memcmp(a->ambient, b->ambient, sizeof(a->ambient)) &&
+            !memcmp(a->diffuse, b->diffuse, sizeof(a->diffuse)) &&
+            !memcmp(a->specular, b->specular, sizeof(a->specular)) &&
+            a->shininess == b->shininess;
+    if (mode & GLM_COLOR)
+        return !memcmp(a->diffuse, b->diffuse, sizeof(GLfloat) * 3);
+    return GL_TRUE;
+}
+
+/* glmNewBatch: returns GL_TRUE if a group (the next in the order of
+ * glmSortGroups()) can't be drawn in the same batch as the previous
+ * one, because the material state has to change in between.
+ */
+static GLboolean
+glmNewBatch(GLMmodel* model, GLuint mode, GLMgroup* previous, GLMgroup* group)
+{
+    if (!previous)
+        return GL_TRUE;
+    if (!(mode & (GLM_COLOR | GLM_MATERIAL)))
+        return GL_FALSE;
+    return !glmSameMaterial(&model->materials[previous->material],
+        &model->materials[group->material], mode);
+}
+
+/* glmDrawStats: Counts the draw calls and material state changes
+ * glmDraw() (or glmDrawBuffers()) issues to render the model in the
+ * mode specified.  Groups are sorted by material, and consecutive
+ * groups that look the same are drawn together, so there is at most
+ * one draw per distinct material rather than one per group.
  *
- * model - pointer to initialized GLMmodel structure
+ * model    - initialized GLMmodel structure
+ * mode     - render mode (see glmDraw())
+ * draws    - set to the number of draw calls (glBegin()/glEnd() pairs
+ *            or glDrawElements())
+ * states   - set to the number of glMaterial()/glColor() calls
  */
 GLvoid
-glmLinearTexture(GLMmodel* model)
+glmDrawStats(GLMmodel* model, GLuint mode, GLuint* draws, GLuint* states)
 {
-    GLMgroup *group;
-    GLfloat dimensions[3];
-    GLfloat x, y, scalefactor;
-    GLuint i;
+    GLMgroup** groups;
+    GLuint     i;
     
     assert(model);
     
-    if (model->texcoords)
-        free(model->texcoords);
-    model->numtexcoords = model->numvertices;
-    model->texcoords=(GLfloat*)malloc(sizeof(GLfloat)*2*(model->numtexcoords+1));
-    
-    glmDimensions(model, dimensions);
-    scalefactor = 2.0 / 
-        glmAbs(glmMax(glmMax(dimensions[0], dimensions[1]), dimensions[2]));
-    
-    /* do the calculations */
-    for(i = 1; i <= model->numvertices; i++) {
-        x = model->vertices[3 * i + 0] * scalefactor;
-        y = model->vertices[3 * i + 2] * scalefactor;
-        model->texcoords[2 * i + 0] = (x + 1.0) / 2.0;
-        model->texcoords[2 * i + 1] = (y + 1.0) / 2.0;
-    }
-    
-    /* go through and put texture coordinate indices in all the triangles */
-    group = model->groups;
-    while(group) {
-        for(i = 0; i < group->numtriangles; i++) {
-            T(group->triangles[i]).tindices[0] = T(group->triangles[i]).vindices[0];
-            T(group->triangles[i]).tindices[1] = T(group->triangles[i]).vindices[1];
-            T(group->triangles[i]).tindices[2] = T(group->triangles[i]).vindices[2];
-        }    
-        group = group->next;
-    }
+    mode = glmCheckMode(model, mode);
+    groups = glmSortGroups(model, mode);
+    *draws = 0;
+    for (i = 0; groups[i]; i++)
+        if (glmNewBatch(model, mode, i ? groups[i - 1] : NULL, groups[i]))
+            (*draws)++;
+    free(groups);
     
-#if 0
-    printf("glmLinearTexture(): generated %d linear texture coordinates\n",
-        model->numtexcoords);
-#endif
+    *states = 0;
+    if (mode & GLM_MATERIAL)
+        *states = 4 * *draws;
+    else if (mode & GLM_COLOR)
+        *states = *draws;
 }
 
-/* glmSpheremapTexture: Generates texture coordinates according to a
- * spherical projection of the texture map.  Sometimes referred to as
- * spheremap, or reflection map texture coordinates.  It generates
- * these by using the normal to calculate where that vertex would map
- * onto a sphere.  Since it is impossible to map something flat
- * perfectly onto something spherical, there is distortion at the
- * poles.  This particular implementation causes the poles along the X
- * axis to be distorted.
+/* glmDraw: Renders the model to the current OpenGL context using the
+ * mode specified.
  *
- * model - pointer to initialized GLMmodel structure
+ * model - initialized GLMmodel structure
+ * mode  - a bitwise OR of values describing what is to be rendered.
+ *             GLM_NONE     -  render with only vertices
+ *             GLM_FLAT     -  render with facet normals
+ *             GLM_SMOOTH   -  render with vertex normals
+ *             GLM_TEXTURE  -  render with texture coords
+ *             GLM_COLOR    -  render with colors (color material)
+ *             GLM_MATERIAL -  render with materials
+ *             GLM_COLOR and GLM_MATERIAL should not both be specified.  
+ *             GLM_FLAT and GLM_SMOOTH should not both be specified.  
  */
 GLvoid
-glmSpheremapTexture(GLMmodel* model)
+glmDraw(GLMmodel* model, GLuint mode)
 {
-    GLMgroup* group;
-    GLfloat theta, phi, rho, x, y, z, r;
-    GLuint i;
+    GLMgroup**   groups;
+    GLMgroup*    group;
+    GLMtriangle* triangle;
+    GLMmaterial* material;
+    GLuint       g, i;
     
     assert(model);
-    assert(model->normals);
+    assert(model->vertices);
     
-    if (model->texcoords)
-        free(model->texcoords);
-    model->numtexcoords = model->numnormals;
-    model->texcoords=(GLfloat*)malloc(sizeof(GLfloat)*2*(model->numtexcoords+1));
+    mode = glmCheckMode(model, mode);
+    if (mode & GLM_COLOR)
+        glEnable(GL_COLOR_MATERIAL);
+    else if (mode & GLM_MATERIAL)
+        glDisable(GL_COLOR_MATERIAL);
     
-    for (i = 1; i <= model->numnormals; i++) {
-        z = model->normals[3 * i + 0];  /* re-arrange for pole distortion */
-        y = model->normals[3 * i + 1];
-        x = model->normals[3 * i + 2];
-        r = sqrt((x * x) + (y * y));
-        rho = sqrt((r * r) + (z * z));
-        
-        if(r == 0.0) {
-            theta = 0.0;
-            phi = 0.0;
-        } else {
-            if(z == 0.0)
-                phi = 3.14159265 / 2.0;
-            else
-                phi = acos(z / rho);
+    /* perhaps this loop should be unrolled into material, color, flat,
+       smooth, etc. loops?  since most cpu's have good branch prediction
+       schemes (and these branches will always go one way), probably
+       wouldn't gain too much?  */
+    
+    /* groups come sorted by material, and a run of groups that look
+       the same goes in one glBegin()/glEnd() with one material change */
+    material = NULL;
+    groups = glmSortGroups(model, mode);
+    for (g = 0; groups[g]; g++) {
+        group = groups[g];
+        if (glmNewBatch(model, mode, g ? groups[g - 1] : NULL, group)) {
+            if (g)
+                glEnd();
             
-            if(y == 0.0)
-                theta = 3.141592365 / 2.0;
-            else
-                theta = asin(y / r) + (3.14159265 / 2.0);
+            if (mode & (GLM_COLOR | GLM_MATERIAL))
+                material = &model->materials[group->material];
+            
+            if (mode & GLM_MATERIAL) {
+                glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material->ambient);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material->diffuse);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material->specular);
+                glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shininess);
+            }
+            
+            if (mode & GLM_COLOR) {
+                glColor3fv(material->diffuse);
+            }
+            
+            glBegin(GL_TRIANGLES);
         }
-        
-        model->texcoords[2 * i + 0] = theta / 3.14159265;
-        model->texcoords[2 * i + 1] = phi / 3.14159265;
-    }
-    
-    /* go through and put texcoord indices in all the triangles */
-    group = model->groups;
-    while(group) {
         for (i = 0; i < group->numtriangles; i++) {
-            T(group->triangles[i]).tindices[0] = T(group->triangles[i]).nindices[0];
-            T(group->triangles[i]).tindices[1] = T(group->triangles[i]).nindices[1];
-            T(group->triangles[i]).tindices[2] = T(group->triangles[i]).nindices[2];
+            triangle = &T(group->triangles[i]);
+            
+            if (mode & GLM_FLAT)
+                glNormal3fv(&model->facetnorms[3 * triangle->findex]);
+            
+            if (mode & GLM_SMOOTH)
+                glNormal3fv(&model->normals[3 * triangle->nindices[0]]);
+            if (mode & GLM_TEXTURE)
+                glTexCoord2fv(&model->texcoords[2 * triangle->tindices[0]]);
+            glVertex3fv(&model->vertices[3 * triangle->vindices[0]]);
+            
+            if (mode & GLM_SMOOTH)
+                glNormal3fv(&model->normals[3 * triangle->nindices[1]]);
+            if (mode & GLM_TEXTURE)
+                glTexCoord2fv(&model->texcoords[2 * triangle->tindices[1]]);
+            glVertex3fv(&model->vertices[3 * triangle->vindices[1]]);
+            
+            if (mode & GLM_SMOOTH)
+                glNormal3fv(&model->normals[3 * triangle->nindices[2]]);
+            if (mode & GLM_TEXTURE)
+                glTexCoord2fv(&model->texcoords[2 * triangle->tindices[2]]);
+            glVertex3fv(&model->vertices[3 * triangle->vindices[2]]);
+            
         }
-        group = group->next;
     }
+    if (g)
+        glEnd();
+    free(groups);
 }
 
-/* glmDelete: Deletes a GLMmodel structure.
+/* glmList: Generates and returns a display list for the model using
+ * the mode specified.
  *
  * model - initialized GLMmodel structure
+ * mode  - a bitwise OR of values describing what is to be rendered.
+ *             GLM_NONE     -  render with only vertices
+ *             GLM_FLAT     -  render with facet normals
+ *             GLM_SMOOTH   -  render with vertex normals
+ *             GLM_TEXTURE  -  render with texture coords
+ *             GLM_COLOR    -  render with colors (color material)
+ *             GLM_MATERIAL -  render with materials
+ *             GLM_COLOR and GLM_MATERIAL should not both be specified.  
+ * GLM_FLAT and GLM_SMOOTH should not both be specified.  
  */
-GLvoid
-glmDelete(GLMmodel* model)
+GLuint
+glmList(GLMmodel* model, GLuint mode)
 {
-    GLMgroup* group;
-    GLuint i;
+    GLuint list;
     
-    assert(model);
+    list = glGenLists(1);
+    glNewList(list, GL_COMPILE);
+    glmDraw(model, mode);
+    glEndList();
     
-    if (model->pathname)     free(model->pathname);
-    if (model->mtllibname) free(model->mtllibname);
-    if (model->vertices)     free(model->vertices);
-    if (model->normals)  free(model->normals);
-    if (model->texcoords)  free(model->texcoords);
-    if (model->facetnorms) free(model->facetnorms);
-    if (model->triangles)  free(model->triangles);
-    if (model->materials) {
-        for (i = 0; i < model->nummaterials; i++)
-            free(model->materials[i].name);
-    }
-    free(model->materials);
-    while(model->groups) {
-        group = model->groups;
-        model->groups = model->groups->next;
-        free(group->name);
-        free(group->triangles);
-        free(group);
+    return list;
+}
+
+/* buffer object entry points (OpenGL 1.5), looked up at run time */
+typedef GLvoid (APIENTRY *GLMgenbuffers)(GLsizei n, GLuint* buffers);
+typedef GLvoid (APIENTRY *GLMdeletebuffers)(GLsizei n, const GLuint* buffers);
+typedef GLvoid (APIENTRY *GLMbindbuffer)(GLenum target, GLuint buffer);
+typedef GLvoid (APIENTRY *GLMbufferdata)(GLenum target, ptrdiff_t size,
+                                         const GLvoid* data, GLenum usage);
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER         0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW          0x88E4
+#endif
+
+/* GLMprocs: the buffer object entry points of the GL context buffers
+ * were uploaded to (kept with the buffers rather than in globals, as
+ * they can differ between contexts).
+ */
+typedef struct _GLMprocs {
+    GLMgenbuffers    genbuffers;
+    GLMdeletebuffers deletebuffers;
+    GLMbindbuffer    bindbuffer;
+    GLMbufferdata    bufferdata;
+} GLMprocs;
+
+/* glmBufferProcs: looks up the buffer object entry points of the
+ * current GL context (falling back on the ARB extension ones),
+ * returning GL_FALSE if it doesn't have them.
+ */
+static GLboolean
+glmBufferProcs(GLMprocs* procs)
+{
+    memset(procs, 0, sizeof(GLMprocs));
+#ifdef FREEGLUT
+    procs->genbuffers = (GLMgenbuffers)glutGetProcAddress("glGenBuffers");
+    procs->deletebuffers = (GLMdeletebuffers)glutGetProcAddress("glDeleteBuffers");
+    procs->bindbuffer = (GLMbindbuffer)glutGetProcAddress("glBindBuffer");
+    procs->bufferdata = (GLMbufferdata)glutGetProcAddress("glBufferData");
+    if (!procs->genbuffers || !procs->deletebuffers || 
+        !procs->bindbuffer || !procs->bufferdata) {
+        procs->genbuffers = (GLMgenbuffers)glutGetProcAddress("glGenBuffersARB");
+        procs->deletebuffers = (GLMdeletebuffers)glutGetProcAddress("glDeleteBuffersARB");
+        procs->bindbuffer = (GLMbindbuffer)glutGetProcAddress("glBindBufferARB");
+        procs->bufferdata = (GLMbufferdata)glutGetProcAddress("glBufferDataARB");
     }
+#endif
+    return procs->genbuffers && procs->deletebuffers && 
+        procs->bindbuffer && procs->bufferdata;
+}
+
+/* glmCornerHash: hash of the vertex, normal and texcoord indices of a
+ * triangle corner.
+ */
+static GLuint
+glmCornerHash(GLuint v, GLuint n, GLuint t)
+{
+    GLuint hash;
+    
+    hash = v * 73856093u ^ n * 19349663u ^ t * 83492791u;
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
     
-    free(model);
+    return hash;
 }
 
-/* glmReadOBJ: Reads a model description from a Wavefront .OBJ file.
- * Returns a pointer to the created object which should be free'd with
- * glmDelete().
+/* glmPrepareBuffers: Generates the contents of vertex and index
+ * buffer objects for the model using the mode specified, without
+ * making any GL calls, so it may run on any thread (as long as no
+ * other thread changes the model meanwhile).  Each distinct
+ * vertex/normal/texcoord combination used by a corner is stored once,
+ * interleaved (position, normal, texcoord), and the triangles are
+ * ordered by material (see glmDrawStats()) so that all the groups
+ * drawn with one material make a single range for glDrawElements().
+ * glmUploadBuffers() turns the result into buffer objects.
  *
- * filename - name of the file containing the Wavefront .OBJ format data.  
+ * model    - initialized GLMmodel structure
+ * mode     - a bitwise OR of values describing what is to be rendered
+ *            (see glmDraw()).
  */
-GLMmodel* 
-glmReadOBJ(char* filename)
+GLMbuffers*
+glmPrepareBuffers(GLMmodel* model, GLuint mode)
 {
-    GLMmodel* model;
-    FILE*   file;
+    GLMbuffers*  buffers;
+    GLMgroup**   groups;
+    GLMgroup*    group;
+    GLMtriangle* triangle;
+    GLMrange*    range;
+    GLfloat*     vertices;
+    GLfloat*     vertex;
+    GLuint*      indices;
+    GLuint*      keys;
+    GLuint*      table;
+    GLuint       numcorners, size, components;
+    GLuint       hash, v, n, t, g, i, j, k;
     
-    /* open the file */
-    file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
-            filename);
-        exit(1);
+    assert(model);
+    assert(model->vertices);
+    
+    mode = glmCheckMode(model, mode);
+    components = 3;
+    if (mode & (GLM_FLAT | GLM_SMOOTH))
+        components += 3;
+    if (mode & GLM_TEXTURE)
+        components += 2;
+    
+    buffers = (GLMbuffers*)malloc(sizeof(GLMbuffers));
+    buffers->mode = mode;
+    buffers->stride = sizeof(GLfloat) * components;
+    buffers->vertexbuffer = 0;
+    buffers->indexbuffer = 0;
+    buffers->procs = NULL;
+    buffers->numvertices = 0;
+    buffers->numindices = 0;
+    buffers->numranges = 0;
+    buffers->ranges = (GLMrange*)malloc(sizeof(GLMrange) * 
+        (model->numgroups + 1));
+    
+    /* copy the materials, so the buffers don't depend on the model */
+    buffers->nummaterials = model->nummaterials;
+    buffers->materials = NULL;
+    if (model->nummaterials) {
+        buffers->materials = (GLMmaterial*)malloc(sizeof(GLMmaterial) * 
+            model->nummaterials);
+        memcpy(buffers->materials, model->materials, 
+            sizeof(GLMmaterial) * model->nummaterials);
+        for (i = 0; i < model->nummaterials; i++)
+            buffers->materials[i].name = NULL;
     }
     
-    /* allocate a new model */
-    model = (GLMmodel*)malloc(sizeof(GLMmodel));
-    model->pathname    = strdup(filename);
-    model->mtllibname    = NULL;
-    model->numvertices   = 0;
-    model->vertices    = NULL;
-    model->numnormals    = 0;
-    model->normals     = NULL;
-    model->numtexcoords  = 0;
-    model->texcoords       = NULL;
-    model->numfacetnorms = 0;
-    model->facetnorms    = NULL;
-    model->numtriangles  = 0;
-    model->triangles       = NULL;
-    model->nummaterials  = 0;
-    model->materials       = NULL;
-    model->numgroups       = 0;
-    model->groups      = NULL;
-    model->position[0]   = 0.0;
-    model->position[1]   = 0.0;
-    model->position[2]   = 0.0;
+    numcorners = 0;
+    for (group = model->groups; group; group = group->next)
+        numcorners += 3 * group->numtriangles;
     
-    /* make a first pass through the file to get a count of the number
-    of vertices, normals, texcoords & triangles */
-    glmFirstPass(model, file);
+    /* find the distinct corners through a hash table of their indices */
+    size = 16;
+    while (size < 2 * numcorners)
+        size *= 2;
+    table = (GLuint*)calloc(size, sizeof(GLuint));
+    keys = (GLuint*)malloc(sizeof(GLuint) * 3 * (numcorners + 1));
+    indices = (GLuint*)malloc(sizeof(GLuint) * (numcorners + 1));
+    groups = glmSortGroups(model, mode);
+    range = NULL;
+    for (g = 0; groups[g]; g++) {
+        group = groups[g];
+        if (glmNewBatch(model, mode, g ? groups[g - 1] : NULL, group)) {
+            range = &buffers->ranges[buffers->numranges++];
+            range->first = buffers->numindices;
+            range->count = 0;
+            range->material = group->material;
+        }
+        range->count += 3 * group->numtriangles;
+        
+        for (i = 0; i < group->numtriangles; i++) {
+            triangle = &T(group->triangles[i]);
+            for (j = 0; j < 3; j++) {
+                v = triangle->vindices[j];
+                n = mode & GLM_FLAT ? triangle->findex :
+                    mode & GLM_SMOOTH ? triangle->nindices[j] : 0;
+                t = mode & GLM_TEXTURE ? triangle->tindices[j] : 0;
+                
+                hash = glmCornerHash(v, n, t) & (size - 1);
+                while (table[hash]) {
+                    k = table[hash] - 1;
+                    if (keys[3 * k + 0] == v && keys[3 * k + 1] == n &&
+                        keys[3 * k + 2] == t)
+                        break;
+                    hash = (hash + 1) & (size - 1);
+                }
+                if (!table[hash]) {
+                    k = buffers->numvertices++;
+                    keys[3 * k + 0] = v;
+                    keys[3 * k + 1] = n;
+                    keys[3 * k + 2] = t;
+                    table[hash] = k + 1;
+                }
+                indices[buffers->numindices++] = table[hash] - 1;
+            }
+        }
+    }
+    free(groups);
+    free(table);
     
-    /* allocate memory */
-    model->vertices = (GLfloat*)malloc(sizeof(GLfloat) *
-        3 * (model->numvertices + 1));
-    model->triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) *
-        model->numtriangles);
-    if (model->numnormals) {
-        model->normals = (GLfloat*)malloc(sizeof(GLfloat) *
-            3 * (model->numnormals + 1));
+    /* then interleave their data */
+    vertices = (GLfloat*)malloc(buffers->stride * (buffers->numvertices + 1));
+    for (k = 0; k < buffers->numvertices; k++) {
+        vertex = &vertices[components * k];
+        memcpy(vertex, &model->vertices[3 * keys[3 * k + 0]], 
+            sizeof(GLfloat) * 3);
+        vertex += 3;
+        if (mode & GLM_FLAT) {
+            memcpy(vertex, &model->facetnorms[3 * keys[3 * k + 1]],
+                sizeof(GLfloat) * 3);
+            vertex += 3;
+        } else if (mode & GLM_SMOOTH) {
+            memcpy(vertex, &model->normals[3 * keys[3 * k + 1]],
+                sizeof(GLfloat) * 3);
+            vertex += 3;
+        }
+        if (mode & GLM_TEXTURE)
+            memcpy(vertex, &model->texcoords[2 * keys[3 * k + 2]],
+                sizeof(GLfloat) * 2);
     }
-    if (model->numtexcoords) {
-        model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) *
-            2 * (model->numtexcoords + 1));
+    free(keys);
+    
+    buffers->vertices = vertices;
+    buffers->indices = indices;
+    
+    return buffers;
+}
+
+/* glmUploadBuffers: Creates the buffer objects for buffers generated
+ * by glmPrepareBuffers() in the current GL context (so it must be
+ * called on the thread the context is current on), and frees their
+ * contents from client memory.  Returns GL_FALSE if the GL has no
+ * buffer objects.
+ *
+ * buffers - buffers generated by glmPrepareBuffers()
+ */
+GLboolean
+glmUploadBuffers(GLMbuffers* buffers)
+{
+    GLMprocs* procs;
+    
+    assert(buffers);
+    assert(buffers->vertices && buffers->indices);
+    
+    procs = (GLMprocs*)malloc(sizeof(GLMprocs));
+    if (!glmBufferProcs(procs)) {
+        free(procs);
+        return GL_FALSE;
     }
+    buffers->procs = procs;
     
-    /* rewind to beginning of file and read in the data this pass */
-    rewind(file);
+    procs->genbuffers(1, &buffers->vertexbuffer);
+    procs->bindbuffer(GL_ARRAY_BUFFER, buffers->vertexbuffer);
+    procs->bufferdata(GL_ARRAY_BUFFER, buffers->stride * buffers->numvertices,
+        buffers->vertices, GL_STATIC_DRAW);
+    procs->bindbuffer(GL_ARRAY_BUFFER, 0);
     
-    glmSecondPass(model, file);
+    procs->genbuffers(1, &buffers->indexbuffer);
+    procs->bindbuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->indexbuffer);
+    procs->bufferdata(GL_ELEMENT_ARRAY_BUFFER, 
+        sizeof(GLuint) * buffers->numindices, buffers->indices, GL_STATIC_DRAW);
+    procs->bindbuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     
-    /* close the file */
-    fclose(file);
+    free(buffers->vertices);
+    free(buffers->indices);
+    buffers->vertices = NULL;
+    buffers->indices = NULL;
     
-    return model;
+    return GL_TRUE;
 }
 
-/* glmWriteOBJ: Writes a model description in Wavefront .OBJ format to
- * a file.
+/* glmBuffers: Generates vertex and index buffer objects for the model
+ * using the mode specified and returns them (or NULL if the GL has no
+ * buffer objects).  Same as glmPrepareBuffers() followed by
+ * glmUploadBuffers().
  *
- * model - initialized GLMmodel structure
- * filename - name of the file to write the Wavefront .OBJ format data to
- * mode  - a bitwise or of values describing what is written to the file
- *             GLM_NONE     -  render with only vertices
- *             GLM_FLAT     -  render with facet normals
- *             GLM_SMOOTH   -  render with vertex normals
- *             GLM_TEXTURE  -  render with texture coords
- *             GLM_COLOR    -  render with colors (color material)
- *             GLM_MATERIAL -  render with materials
- *             GLM_COLOR and GLM_MATERIAL should not both be specified.  
- *             GLM_FLAT and GLM_SMOOTH should not both be specified.  
+ * model    - initialized GLMmodel structure
+ * mode     - a bitwise OR of values describing what is to be rendered
+ *            (see glmDraw()).
  */
-GLvoid
-glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode)
+GLMbuffers*
+glmBuffers(GLMmodel* model, GLuint mode)
 {
-    GLuint  i;
-    FILE*   file;
-    GLMgroup* group;
+    GLMbuffers* buffers;
+    GLMprocs    procs;
     
     assert(model);
     
-    /* do a bit of warning */
-    if (mode & GLM_FLAT && !model->facetnorms) {
-        printf("glmWriteOBJ() warning: flat normal output requested "
-            "with no facet normals defined.\n");
-        mode &= ~GLM_FLAT;
-    }
-    if (mode & GLM_SMOOTH && !model->normals) {
-        printf("glmWriteOBJ() warning: smooth normal output requested "
-            "with no normals defined.\n");
-        mode &= ~GLM_SMOOTH;
-    }
-    if (mode & GLM_TEXTURE && !model->texcoords) {
-        printf("glmWriteOBJ() warning: texture coordinate output requested "
-            "with no texture coordinates defined.\n");
-        mode &= ~GLM_TEXTURE;
-    }
-    if (mode & GLM_FLAT && mode & GLM_SMOOTH) {
-        printf("glmWriteOBJ() warning: flat normal output requested "
-            "and smooth normal output requested (using smooth).\n");
-        mode &= ~GLM_FLAT;
-    }
-    if (mode & GLM_COLOR && !model->materials) {
-        printf("glmWriteOBJ() warning: color output requested "
-            "with no colors (materials) defined.\n");
-        mode &= ~GLM_COLOR;
+    if (!glmBufferProcs(&procs))
+        return NULL;
+    
+    buffers = glmPrepareBuffers(model, mode);
+    if (!glmUploadBuffers(buffers)) {
+        glmDeleteBuffers(buffers);
+        return NULL;
     }
-    if (mode & GLM_MATERIAL && !model->materials) {
-        printf("glmWriteOBJ() warning: material output requested "
-            "with no materials defined.\n");
-        mode &= ~GLM_MATERIAL;
+    
+    return buffers;
+}
+
+/* glmDrawBuffers: Renders buffer objects generated by glmBuffers() (or
+ * uploaded by glmUploadBuffers()) to the current OpenGL context, in
+ * the mode they were generated with.
+ *
+ * buffers - buffers generated by glmBuffers()
+ */
+GLvoid
+glmDrawBuffers(GLMbuffers* buffers)
+{
+    GLMmaterial* material;
+    GLMrange*    range;
+    GLMprocs*    procs;
+    GLuint       offset, i;
+    
+    assert(buffers);
+    assert(buffers->procs);
+    
+    procs = buffers->procs;
+    procs->bindbuffer(GL_ARRAY_BUFFER, buffers->vertexbuffer);
+    procs->bindbuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->indexbuffer);
+    
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, buffers->stride, (GLvoid*)0);
+    offset = sizeof(GLfloat) * 3;
+    if (buffers->mode & (GLM_FLAT | GLM_SMOOTH)) {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, buffers->stride, (GLvoid*)(size_t)offset);
+        offset += sizeof(GLfloat) * 3;
     }
-    if (mode & GLM_COLOR && mode & GLM_MATERIAL) {
-        printf("glmWriteOBJ() warning: color and material output requested "
-            "outputting only materials.\n");
-        mode &= ~GLM_COLOR;
+    if (buffers->mode & GLM_TEXTURE) {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, buffers->stride, 
+            (GLvoid*)(size_t)offset);
     }
     
+    if (buffers->mode & GLM_COLOR)
+        glEnable(GL_COLOR_MATERIAL);
+    else if (buffers->mode & GLM_MATERIAL)
+        glDisable(GL_COLOR_MATERIAL);
     
-    /* open the file */
-    file = fopen(filename, "w");
-    if (!file) {
-        fprintf(stderr, "glmWriteOBJ() failed: can't open file \"%s\" to write.\n",
-            filename);
-        exit(1);
+    for (i = 0; i < buffers->numranges; i++) {
+        range = &buffers->ranges[i];
+        if (buffers->mode & (GLM_COLOR | GLM_MATERIAL)) {
+            material = &buffers->materials[range->material];
+            if (buffers->mode & GLM_MATERIAL) {
+                glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material->ambient);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material->diffuse);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material->specular);
+                glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shininess);
+            } else {
+                glColor3fv(material->diffuse);
+            }
+        }
+        glDrawElements(GL_TRIANGLES, range->count, GL_UNSIGNED_INT, 
+            (GLvoid*)(sizeof(GLuint) * range->first));
     }
     
-    /* spit out a header */
-    fprintf(file, "#  \n");
-    fprintf(file, "#  Wavefront OBJ generated by GLM library\n");
-    fprintf(file, "#  \n");
-    fprintf(file, "#  GLM library\n");
-    fprintf(file, "#  Nate Robins\n");
-    fprintf(file, "#  ndr@pobox.com\n");
-    fprintf(file, "#  http://www.pobox.com/~ndr\n");
-    fprintf(file, "#  \n");
+    glPopClientAttrib();
+    procs->bindbuffer(GL_ARRAY_BUFFER, 0);
+    procs->bindbuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+/* glmDeleteBuffers: Deletes buffers generated by glmBuffers() or
+ * glmPrepareBuffers() (uploaded or not).
+ *
+ * buffers - buffers generated by glmBuffers() or glmPrepareBuffers()
+ */
+GLvoid
+glmDeleteBuffers(GLMbuffers* buffers)
+{
+    assert(buffers);
     
-    if (mode & GLM_MATERIAL && model->mtllibname) {
-        fprintf(file, "\nmtllib %s\n\n", model->mtllibname);
-        glmWriteMTL(model, filename, model->mtllibname);
+    if (buffers->procs) {
+        buffers->procs->deletebuffers(1, &buffers->vertexbuffer);
+        buffers->procs->deletebuffers(1, &buffers->indexbuffer);
+        free(buffers->procs);
     }
-    
-    /* spit out the vertices */
-    fprintf(file, "\n");
-    fprintf(file, "# %d vertices\n", model->numvertices);
-    for (i = 1; i <= model->numvertices; i++) {
-        fprintf(file, "v %f %f %f\n", 
-            model->vertices[3 * i + 0],
-            model->vertices[3 * i + 1],
-            model->vertices[3 * i + 2]);
+    free(buffers->vertices);
+    free(buffers->indices);
+    free(buffers->materials);
+    free(buffers->ranges);
+    free(buffers);
+}
+
+/* glmTriangleIndices: returns one kind of index of a triangle
+ * (0 = vertex, 1 = normal, 2 = texcoord).
+ */
+static GLuint*
+glmTriangleIndices(GLMtriangle* triangle, GLuint kind)
+{
+    switch (kind) {
+    case 1:
+        return triangle->nindices;
+    case 2:
+        return triangle->tindices;
+    default:
+        return triangle->vindices;
     }
+}
+
+/* glmCompactIndices: Returns one kind of index (see
+ * glmTriangleIndices()) of the triangles of a model, in the order
+ * given, in the blocks of a compact model.  The indices of a block are
+ * kept as 16 bit offsets from its smallest one when they fit.
+ *
+ * compact - compact model being made (its triangles counted)
+ * model   - model the triangles are in
+ * order   - the triangles of the model, in compact model order
+ * kind    - kind of index
+ */
+static GLMindexblock*
+glmCompactIndices(GLMcompact* compact, GLMmodel* model, GLuint* order,
+                  GLuint kind)
+{
+    GLMindexblock* blocks;
+    GLMindexblock* block;
+    GLushort* shorts;
+    GLuint*   ints;
+    GLuint*   indices;
+    GLuint    numshorts, numints, first, last, min, max, i, j, k;
     
-    /* spit out the smooth/flat normals */
-    if (mode & GLM_SMOOTH) {
-        fprintf(file, "\n");
-        fprintf(file, "# %d normals\n", model->numnormals);
-        for (i = 1; i <= model->numnormals; i++) {
-            fprintf(file, "vn %f %f %f\n", 
-                model->normals[3 * i + 0],
-                model->normals[3 * i + 1],
-                model->normals[3 * i + 2]);
-        }
-    } else if (mode & GLM_FLAT) {
-        fprintf(file, "\n");
-        fprintf(file, "# %d normals\n", model->numfacetnorms);
-        for (i = 1; i <= model->numnormals; i++) {
-            fprintf(file, "vn %f %f %f\n", 
-                model->facetnorms[3 * i + 0],
-                model->facetnorms[3 * i + 1],
-                model->facetnorms[3 * i + 2]);
-        }
-    }
+    blocks = (GLMindexblock*)glmAlloc(compact->arena, 
+        sizeof(GLMindexblock) * (compact->numblocks + 1));
     
-    /* spit out the texture coordinates */
-    if (mode & GLM_TEXTURE) {
-        fprintf(file, "\n");
-        fprintf(file, "# %d texcoords\n", model->texcoords);
-        for (i = 1; i <= model->numtexcoords; i++) {
-            fprintf(file, "vt %f %f\n", 
-                model->texcoords[2 * i + 0],
-                model->texcoords[2 * i + 1]);
+    /* find the smallest and largest index of each block (marking the
+       blocks that need 32 bits with ints), and count the indices of
+       each size */
+    numshorts = numints = 0;
+    for (i = 0; i < compact->numblocks; i++) {
+        block = &blocks[i];
+        first = i * compact->blocksize;
+        last = first + compact->blocksize;
+        if (last > compact->numtriangles)
+            last = compact->numtriangles;
+        
+        min = ~0u;
+        max = 0;
+        for (j = first; j < last; j++) {
+            indices = glmTriangleIndices(&T(order[j]), kind);
+            for (k = 0; k < 3; k++) {
+                if (min > indices[k])
+                    min = indices[k];
+                if (max < indices[k])
+                    max = indices[k];
+            }
+        }
+        
+        block->base = min;
+        block->shorts = NULL;
+        block->ints = NULL;
+        if (max - min > 0xffff) {
+            block->base = 0;
+            block->ints = (GLuint*)blocks;
+            numints += 3 * (last - first);
+        } else {
+            numshorts += 3 * (last - first);
         }
     }
     
-    fprintf(file, "\n");
-    fprintf(file, "# %d groups\n", model->numgroups);
-    fprintf(file, "# %d faces (triangles)\n", model->numtriangles);
-    fprintf(file, "\n");
-    
-    group = model->groups;
-    while(group) {
-        fprintf(file, "g %s\n", group->name);
-        if (mode & GLM_MATERIAL)
-            fprintf(file, "usemtl %s\n", model->materials[group->material].name);
-        for (i = 0; i < group->numtriangles; i++) {
-            if (mode & GLM_SMOOTH && mode & GLM_TEXTURE) {
-                fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                    T(group->triangles[i]).vindices[0], 
-                    T(group->triangles[i]).nindices[0], 
-                    T(group->triangles[i]).tindices[0],
-                    T(group->triangles[i]).vindices[1],
-                    T(group->triangles[i]).nindices[1],
-                    T(group->triangles[i]).tindices[1],
-                    T(group->triangles[i]).vindices[2],
-                    T(group->triangles[i]).nindices[2],
-                    T(group->triangles[i]).tindices[2]);
-            } else if (mode & GLM_FLAT && mode & GLM_TEXTURE) {
-                fprintf(file, "f %d/%d %d/%d %d/%d\n",
-                    T(group->triangles[i]).vindices[0],
-                    T(group->triangles[i]).findex,
-                    T(group->triangles[i]).vindices[1],
-                    T(group->triangles[i]).findex,
-                    T(group->triangles[i]).vindices[2],
-                    T(group->triangles[i]).findex);
-            } else if (mode & GLM_TEXTURE) {
-                fprintf(file, "f %d/%d %d/%d %d/%d\n",
-                    T(group->triangles[i]).vindices[0],
-                    T(group->triangles[i]).tindices[0],
-                    T(group->triangles[i]).vindices[1],
-                    T(group->triangles[i]).tindices[1],
-                    T(group->triangles[i]).vindices[2],
-                    T(group->triangles[i]).tindices[2]);
-            } else if (mode & GLM_SMOOTH) {
-                fprintf(file, "f %d//%d %d//%d %d//%d\n",
-                    T(group->triangles[i]).vindices[0],
-                    T(group->triangles[i]).nindices[0],
-                    T(group->triangles[i]).vindices[1],
-                    T(group->triangles[i]).nindices[1],
-                    T(group->triangles[i]).vindices[2], 
-                    T(group->triangles[i]).nindices[2]);
-            } else if (mode & GLM_FLAT) {
-                fprintf(file, "f %d//%d %d//%d %d//%d\n",
-                    T(group->triangles[i]).vindices[0], 
-                    T(group->triangles[i]).findex,
-                    T(group->triangles[i]).vindices[1],
-                    T(group->triangles[i]).findex,
-                    T(group->triangles[i]).vindices[2],
-                    T(group->triangles[i]).findex);
-            } else {
-                fprintf(file, "f %d %d %d\n",
-                    T(group->triangles[i]).vindices[0],
-                    T(group->triangles[i]).vindices[1],
-                    T(group->triangles[i]).vindices[2]);
+    /* then hand out the indices */
+    shorts = (GLushort*)glmAlloc(compact->arena, 
+        sizeof(GLushort) * (numshorts + 1));
+    ints = (GLuint*)glmAlloc(compact->arena, sizeof(GLuint) * (numints + 1));
+    for (i = 0; i < compact->numblocks; i++) {
+        block = &blocks[i];
+        first = i * compact->blocksize;
+        last = first + compact->blocksize;
+        if (last > compact->numtriangles)
+            last = compact->numtriangles;
+        
+        if (block->ints) {
+            block->ints = ints;
+            for (j = first; j < last; j++) {
+                indices = glmTriangleIndices(&T(order[j]), kind);
+                for (k = 0; k < 3; k++)
+                    *ints++ = indices[k];
+            }
+        } else {
+            block->shorts = shorts;
+            for (j = first; j < last; j++) {
+                indices = glmTriangleIndices(&T(order[j]), kind);
+                for (k = 0; k < 3; k++)
+                    *shorts++ = (GLushort)(indices[k] - block->base);
             }
         }
-        fprintf(file, "\n");
-        group = group->next;
     }
     
-    fclose(file);
+    return blocks;
 }
 
-/* glmDraw: Renders the model to the current OpenGL context using the
- * mode specified.
+/* glmCompactCopy: copies an array into the memory of a compact model */
+static GLvoid*
+glmCompactCopy(GLMcompact* compact, GLvoid* p, size_t size)
+{
+    return memcpy(glmAlloc(compact->arena, size), p, size);
+}
+
+/* glmCompact: Returns a compact copy of a model (which can then be
+ * deleted).  Its triangles are put in group order, so each group is a
+ * range of them, and only the indices the model has are kept: in
+ * blocks that take 16 bits an index when their indices are close
+ * enough together.  Should be free'd with glmDeleteCompact().
  *
  * model - initialized GLMmodel structure
- * mode  - a bitwise OR of values describing what is to be rendered.
- *             GLM_NONE     -  render with only vertices
- *             GLM_FLAT     -  render with facet normals
- *             GLM_SMOOTH   -  render with vertex normals
- *             GLM_TEXTURE  -  render with texture coords
- *             GLM_COLOR    -  render with colors (color material)
- *             GLM_MATERIAL -  render with materials
- *             GLM_COLOR and GLM_MATERIAL should not both be specified.  
- *             GLM_FLAT and GLM_SMOOTH should not both be specified.  
  */
-GLvoid
-glmDraw(GLMmodel* model, GLuint mode)
+GLMcompact*
+glmCompact(GLMmodel* model)
 {
-    static GLuint i;
-    static GLMgroup* group;
-    static GLMtriangle* triangle;
-    static GLMmaterial* material;
+    GLMarena*   arena;
+    GLMcompact* compact;
+    GLMgroup*   group;
+    GLMcompactgroup* part;
+    GLuint*     order;
+    GLuint      i, g;
     
     assert(model);
     assert(model->vertices);
     
-    /* do a bit of warning */
-    if (mode & GLM_FLAT && !model->facetnorms) {
-        printf("glmDraw() warning: flat render mode requested "
-            "with no facet normals defined.\n");
-        mode &= ~GLM_FLAT;
+    arena = glmNewArena();
+    compact = (GLMcompact*)glmArenaCut(arena, sizeof(GLMcompact));
+    compact->arena = arena;
+    compact->pathname = glmStrdup(arena, model->pathname);
+    
+    /* the groups with triangles, in the order they were added, each
+       with its triangles in a range of their own */
+    if (!model->grouparray)
+        glmIndexGroups(model);
+    compact->numgroups = 0;
+    compact->numtriangles = 0;
+    for (g = 0; g < model->numgroups; g++) {
+        if (model->grouparray[g]->numtriangles) {
+            compact->numgroups++;
+            compact->numtriangles += model->grouparray[g]->numtriangles;
+        }
     }
-    if (mode & GLM_SMOOTH && !model->normals) {
-        printf("glmDraw() warning: smooth render mode requested "
-            "with no normals defined.\n");
-        mode &= ~GLM_SMOOTH;
+    compact->groups = (GLMcompactgroup*)glmAlloc(arena, 
+        sizeof(GLMcompactgroup) * (compact->numgroups + 1));
+    order = (GLuint*)malloc(sizeof(GLuint) * (compact->numtriangles + 1));
+    part = compact->groups;
+    i = 0;
+    for (g = 0; g < model->numgroups; g++) {
+        group = model->grouparray[g];
+        if (!group->numtriangles)
+            continue;
+        part->name = glmStrdup(arena, group->name);
+        part->material = group->material;
+        part->first = i;
+        part->count = group->numtriangles;
+        memcpy(&order[i], group->triangles, 
+            sizeof(GLuint) * group->numtriangles);
+        i += group->numtriangles;
+        part++;
     }
-    if (mode & GLM_TEXTURE && !model->texcoords) {
-        printf("glmDraw() warning: texture render mode requested "
-            "with no texture coordinates defined.\n");
-        mode &= ~GLM_TEXTURE;
+    
+    /* the vectors as they are, and facet normals in triangle order */
+    compact->numvertices = model->numvertices;
+    compact->vertices = (GLfloat*)glmCompactCopy(compact, model->vertices,
+        sizeof(GLfloat) * 3 * (model->numvertices + 1));
+    compact->numnormals = 0;
+    compact->normals = NULL;
+    if (model->normals && model->numnormals) {
+        compact->numnormals = model->numnormals;
+        compact->normals = (GLfloat*)glmCompactCopy(compact, model->normals,
+            sizeof(GLfloat) * 3 * (model->numnormals + 1));
     }
-    if (mode & GLM_FLAT && mode & GLM_SMOOTH) {
-        printf("glmDraw() warning: flat render mode requested "
-            "and smooth render mode requested (using smooth).\n");
-        mode &= ~GLM_FLAT;
+    compact->numtexcoords = 0;
+    compact->texcoords = NULL;
+    if (model->texcoords && model->numtexcoords) {
+        compact->numtexcoords = model->numtexcoords;
+        compact->texcoords = (GLfloat*)glmCompactCopy(compact, 
+            model->texcoords, 
+            sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
     }
-    if (mode & GLM_COLOR && !model->materials) {
-        printf("glmDraw() warning: color render mode requested "
-            "with no materials defined.\n");
-        mode &= ~GLM_COLOR;
+    compact->facetnorms = NULL;
+    if (model->facetnorms) {
+        compact->facetnorms = (GLfloat*)glmAlloc(arena, 
+            sizeof(GLfloat) * 3 * (compact->numtriangles + 1));
+        for (i = 0; i < compact->numtriangles; i++)
+            memcpy(&compact->facetnorms[3 * i], 
+                &model->facetnorms[3 * T(order[i]).findex], 
+                sizeof(GLfloat) * 3);
     }
-    if (mode & GLM_MATERIAL && !model->materials) {
-        printf("glmDraw() warning: material render mode requested "
-            "with no materials defined.\n");
-        mode &= ~GLM_MATERIAL;
+    
+    /* the indices there are vectors for */
+    compact->blocksize = GLM_COMPACT_BLOCK;
+    compact->numblocks = (compact->numtriangles + compact->blocksize - 1) /
+        compact->blocksize;
+    compact->vindices = glmCompactIndices(compact, model, order, 0);
+    compact->nindices = compact->normals ? 
+        glmCompactIndices(compact, model, order, 1) : NULL;
+    compact->tindices = compact->texcoords ? 
+        glmCompactIndices(compact, model, order, 2) : NULL;
+    free(order);
+    
+    compact->nummaterials = model->nummaterials;
+    compact->materials = NULL;
+    if (model->materials) {
+        compact->materials = (GLMmaterial*)glmCompactCopy(compact, 
+            model->materials, sizeof(GLMmaterial) * model->nummaterials);
+        for (i = 0; i < compact->nummaterials; i++)
+            compact->materials[i].name = glmStrdup(arena, 
+                model->materials[i].name);
     }
-    if (mode & GLM_COLOR && mode & GLM_MATERIAL) {
-        printf("glmDraw() warning: color and material render mode requested "
-            "using only material mode.\n");
-        mode &= ~GLM_COLOR;
+    
+    return compact;
+}
+
+/* glmBlockIndices: gets the 3 indices of a triangle from the blocks
+ * of one kind of index of a compact model.
+ */
+static GLvoid
+glmBlockIndices(GLMcompact* compact, GLMindexblock* blocks, GLuint i, 
+                GLuint* indices)
+{
+    GLMindexblock* block;
+    
+    block = &blocks[i / compact->blocksize];
+    i = 3 * (i % compact->blocksize);
+    if (block->shorts) {
+        indices[0] = block->base + block->shorts[i + 0];
+        indices[1] = block->base + block->shorts[i + 1];
+        indices[2] = block->base + block->shorts[i + 2];
+    } else {
+        indices[0] = block->ints[i + 0];
+        indices[1] = block->ints[i + 1];
+        indices[2] = block->ints[i + 2];
     }
+}
+
+/* glmCompactTriangle: Gets the indices of a triangle of a compact
+ * model.
+ *
+ * compact  - compact model
+ * i        - index of the triangle
+ * vindices - will hold its 3 vertex indices
+ * nindices - will hold its 3 normal indices (0 if none; may be NULL)
+ * tindices - will hold its 3 texcoord indices (0 if none; may be NULL)
+ */
+GLvoid
+glmCompactTriangle(GLMcompact* compact, GLuint i, GLuint* vindices,
+                   GLuint* nindices, GLuint* tindices)
+{
+    assert(compact);
+    assert(i < compact->numtriangles);
+    
+    glmBlockIndices(compact, compact->vindices, i, vindices);
+    if (nindices && compact->nindices)
+        glmBlockIndices(compact, compact->nindices, i, nindices);
+    else if (nindices)
+        nindices[0] = nindices[1] = nindices[2] = 0;
+    if (tindices && compact->tindices)
+        glmBlockIndices(compact, compact->tindices, i, tindices);
+    else if (tindices)
+        tindices[0] = tindices[1] = tindices[2] = 0;
+}
+
+/* glmDrawCompact: Renders a compact model like glmDraw().
+ *
+ * compact - compact model
+ * mode    - render mode (see glmDraw())
+ */
+GLvoid
+glmDrawCompact(GLMcompact* compact, GLuint mode)
+{
+    GLMcompactgroup* group;
+    GLMmaterial* material;
+    GLuint vindices[3], nindices[3], tindices[3];
+    GLuint g, i, k;
+    
+    assert(compact);
+    
+    mode = glmCheckArrays(compact->facetnorms, compact->normals,
+        compact->texcoords, compact->materials, mode);
     if (mode & GLM_COLOR)
         glEnable(GL_COLOR_MATERIAL);
     else if (mode & GLM_MATERIAL)
         glDisable(GL_COLOR_MATERIAL);
     
-    /* perhaps this loop should be unrolled into material, color, flat,
-       smooth, etc. loops?  since most cpu's have good branch prediction
-       schemes (and these branches will always go one way), probably
-       wouldn't gain too much?  */
-    
-    group = model->groups;
-    while (group) {
-        if (mode & GLM_MATERIAL) {
-            material = &model->materials[group->material];
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material->ambient);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material->diffuse);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material->specular);
-            glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shininess);
-        }
-        
-        if (mode & GLM_COLOR) {
-            glColor3fv(material->diffuse);
-        }
-        
-        glBegin(GL_TRIANGLES);
-        for (i = 0; i < group->numtriangles; i++) {
-            triangle = &T(group->triangles[i]);
+    /* each group is a range of triangles, and a run of groups with the
+       same material goes in one glBegin()/glEnd() */
+    material = NULL;
+    for (g = 0; g < compact->numgroups; g++) {
+        group = &compact->groups[g];
+        if (!g || ((mode & (GLM_COLOR | GLM_MATERIAL)) &&
+            group->material != compact->groups[g - 1].material)) {
+            if (g)
+                glEnd();
             
-            if (mode & GLM_FLAT)
-                glNormal3fv(&model->facetnorms[3 * triangle->findex]);
+            if (mode & (GLM_COLOR | GLM_MATERIAL))
+                material = &compact->materials[group->material];
             
-            if (mode & GLM_SMOOTH)
-                glNormal3fv(&model->normals[3 * triangle->nindices[0]]);
-            if (mode & GLM_TEXTURE)
-                glTexCoord2fv(&model->texcoords[2 * triangle->tindices[0]]);
-            glVertex3fv(&model->vertices[3 * triangle->vindices[0]]);
+            if (mode & GLM_MATERIAL) {
+                glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material->ambient);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material->diffuse);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material->specular);
+                glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shininess);
+            }
             
-            if (mode & GLM_SMOOTH)
-                glNormal3fv(&model->normals[3 * triangle->nindices[1]]);
-            if (mode & GLM_TEXTURE)
-                glTexCoord2fv(&model->texcoords[2 * triangle->tindices[1]]);
-            glVertex3fv(&model->vertices[3 * triangle->vindices[1]]);
+            if (mode & GLM_COLOR) {
+                glColor3fv(material->diffuse);
+            }
             
-            if (mode & GLM_SMOOTH)
-                glNormal3fv(&model->normals[3 * triangle->nindices[2]]);
-            if (mode & GLM_TEXTURE)
-                glTexCoord2fv(&model->texcoords[2 * triangle->tindices[2]]);
-            glVertex3fv(&model->vertices[3 * triangle->vindices[2]]);
+            glBegin(GL_TRIANGLES);
+        }
+        for (i = group->first; i < group->first + group->count; i++) {
+            glmCompactTriangle(compact, i, vindices, nindices, tindices);
+            
+            if (mode & GLM_FLAT)
+                glNormal3fv(&compact->facetnorms[3 * i]);
             
+            for (k = 0; k < 3; k++) {
+                if (mode & GLM_SMOOTH)
+                    glNormal3fv(&compact->normals[3 * nindices[k]]);
+                if (mode & GLM_TEXTURE)
+                    glTexCoord2fv(&compact->texcoords[2 * tindices[k]]);
+                glVertex3fv(&compact->vertices[3 * vindices[k]]);
+            }
         }
-        glEnd();
-        
-        group = group->next;
     }
+    if (g)
+        glEnd();
 }
 
-/* glmList: Generates and returns a display list for the model using
- * the mode specified.
+/* glmListCompact: Generates and returns a display list for a compact
+ * model like glmList().
  *
- * model - initialized GLMmodel structure
- * mode  - a bitwise OR of values describing what is to be rendered.
- *             GLM_NONE     -  render with only vertices
- *             GLM_FLAT     -  render with facet normals
- *             GLM_SMOOTH   -  render with vertex normals
- *             GLM_TEXTURE  -  render with texture coords
- *             GLM_COLOR    -  render with colors (color material)
- *             GLM_MATERIAL -  render with materials
- *             GLM_COLOR and GLM_MATERIAL should not both be specified.  
- * GLM_FLAT and GLM_SMOOTH should not both be specified.  
+ * compact - compact model
+ * mode    - render mode (see glmDraw())
  */
 GLuint
-glmList(GLMmodel* model, GLuint mode)
+glmListCompact(GLMcompact* compact, GLuint mode)
 {
     GLuint list;
     
     list = glGenLists(1);
     glNewList(list, GL_COMPILE);
-    glmDraw(model, mode);
+    glmDrawCompact(compact, mode);
     glEndList();
     
     return list;
 }
 
+/* glmCompactMemory: Returns the bytes of memory a compact model takes
+ * up.
+ *
+ * compact - compact model
+ */
+size_t
+glmCompactMemory(GLMcompact* compact)
+{
+    assert(compact);
+    
+    return glmArenaSize(compact->arena);
+}
+
+/* glmDeleteCompact: Deletes a compact model.
+ *
+ * compact - compact model
+ */
+GLvoid
+glmDeleteCompact(GLMcompact* compact)
+{
+    assert(compact);
+    
+    /* the compact model itself is in its arena too */
+    glmFreeArena(compact->arena);
+}
+
 /* glmWeld: eliminate (weld) vectors that are within an epsilon of
  * each other.
  *
@@ -1723,11 +6076,13 @@ glmWeld(GLMmodel* model, GLfloat epsilon)
     /* vertices */
     numvectors = model->numvertices;
     vectors  = model->vertices;
-    copies = glmWeldVectors(vectors, &numvectors, epsilon);
+    glmFreeSmoothing(model);
+    copies = glmWeldVectors(vectors, &numvectors, epsilon, 
+        model->numthreads);
     
 #if 1
     printf("glmWeld(): %d redundant vertices.\n", 
-        model->numvertices - numvectors - 1);
+        model->numvertices - numvectors);
 #endif
     
     for (i = 0; i < model->numtriangles; i++) {
@@ -1737,11 +6092,11 @@ glmWeld(GLMmodel* model, GLfloat epsilon)
     }
     
     /* free space for old vertices */
-    free(vectors);
+    glmFree(model, vectors);
     
     /* allocate space for the new vertices */
     model->numvertices = numvectors;
-    model->vertices = (GLfloat*)malloc(sizeof(GLfloat) * 
+    model->vertices = (GLfloat*)glmAlloc(model->arena, sizeof(GLfloat) * 
         3 * (model->numvertices + 1));
     
     /* copy the optimized vertices into the actual vertex list */
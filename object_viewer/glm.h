@@ -12,6 +12,7 @@
  */
 
 
+#include <stddef.h>
 #include <GL/glut.h>
 
 
@@ -84,11 +85,109 @@ typedef struct _GLMmodel {
 
   GLuint       numgroups;       /* number of groups in model */
   GLMgroup*    groups;          /* linked list of groups */
+  GLMgroup**   grouparray;      /* groups in the order they were added */
+
+  GLuint*  grouphash;           /* hash table of group names */
+  GLuint   grouphashsize;       /* number of slots in grouphash */
+  GLuint*  materialhash;        /* hash table of material names */
+  GLuint   materialhashsize;    /* number of slots in materialhash */
 
   GLfloat position[3];          /* position of the model */
 
+  GLuint  numthreads;           /* threads to use (0 = one per processor) */
+
+  struct _GLMsmoothing* smoothing;  /* kept by glmSmoothingAngle() */
+
+  GLvoid* mapping;              /* cache file the arrays may live in */
+  size_t  mappingsize;          /* size of the mapped cache file */
+
+  struct _GLMarena* arena;      /* memory the rest of the model lives in */
+
 } GLMmodel;
 
+/* GLMrange: Structure that defines a range of indices drawn with one
+ * material.
+ */
+typedef struct _GLMrange {
+  GLuint first;                 /* first index of the range */
+  GLuint count;                 /* number of indices in the range */
+  GLuint material;              /* index of material for the range */
+} GLMrange;
+
+/* GLMbuffers: Structure that defines the buffer objects of a model.
+ */
+typedef struct _GLMbuffers {
+  GLuint mode;                  /* render mode of the buffers */
+
+  GLuint vertexbuffer;          /* buffer object of interleaved vertices */
+  GLuint numvertices;           /* number of vertices in vertexbuffer */
+  GLuint stride;                /* size of one vertex (in bytes) */
+
+  GLuint indexbuffer;           /* buffer object of triangle indices */
+  GLuint numindices;            /* number of indices in indexbuffer */
+
+  GLuint       nummaterials;    /* number of materials */
+  GLMmaterial* materials;       /* copy of the model's materials */
+
+  GLuint    numranges;          /* number of ranges */
+  GLMrange* ranges;             /* array of ranges (one per material) */
+
+  GLfloat* vertices;            /* interleaved vertices (until uploaded) */
+  GLuint*  indices;             /* triangle indices (until uploaded) */
+  struct _GLMprocs* procs;      /* GL entry points (once uploaded) */
+} GLMbuffers;
+
+/* GLMindexblock: Structure that defines one kind of index (vertex,
+ * normal or texcoord) of a block of triangles in a compact model.
+ */
+typedef struct _GLMindexblock {
+  GLuint    base;               /* smallest index in the block */
+  GLushort* shorts;             /* 3 indices a triangle less base, if
+                                   they all fit in 16 bits (or NULL) */
+  GLuint*   ints;               /* 3 indices a triangle (or NULL) */
+} GLMindexblock;
+
+/* GLMcompactgroup: Structure that defines a group in a compact model.
+ */
+typedef struct _GLMcompactgroup {
+  char*  name;                  /* name of this group */
+  GLuint material;              /* index to material for group */
+  GLuint first;                 /* first triangle of the group */
+  GLuint count;                 /* number of triangles in the group */
+} GLMcompactgroup;
+
+/* GLMcompact: Structure that defines a model stored compactly, its
+ * triangles ordered by group and their indices kept in blocks.
+ */
+typedef struct _GLMcompact {
+  char*    pathname;            /* path to the model */
+
+  GLuint   numvertices;         /* number of vertices */
+  GLfloat* vertices;            /* array of vertices */
+  GLuint   numnormals;          /* number of normals (0 = none) */
+  GLfloat* normals;             /* array of normals (or NULL) */
+  GLuint   numtexcoords;        /* number of texcoords (0 = none) */
+  GLfloat* texcoords;           /* array of texcoords (or NULL) */
+
+  GLuint   numtriangles;        /* number of triangles */
+  GLfloat* facetnorms;          /* facet normal of each triangle, in
+                                   triangle order (or NULL) */
+
+  GLuint   blocksize;           /* triangles in each block of indices */
+  GLuint   numblocks;           /* number of blocks */
+  GLMindexblock* vindices;      /* vertex indices, by block */
+  GLMindexblock* nindices;      /* normal indices (if there are normals) */
+  GLMindexblock* tindices;      /* texcoord indices (if there are any) */
+
+  GLuint       nummaterials;    /* number of materials */
+  GLMmaterial* materials;       /* array of materials */
+
+  GLuint           numgroups;   /* number of groups (with triangles) */
+  GLMcompactgroup* groups;      /* array of groups, in triangle order */
+
+  struct _GLMarena* arena;      /* memory the compact model lives in */
+} GLMcompact;
+
 
 /* glmUnitize: "unitize" a model by translating it to the origin and
  * scaling it to fit in a unit cube around the origin.  Returns the
@@ -127,7 +226,8 @@ glmReverseWinding(GLMmodel* model);
 
 /* glmFacetNormals: Generates facet normals for a model (by taking the
  * cross product of the two vectors derived from the sides of each
- * triangle).  Assumes a counter-clockwise winding.
+ * triangle).  Assumes a counter-clockwise winding.  The old facet
+ * normals array is reused if the number of triangles hasn't changed.
  *
  * model - initialized GLMmodel structure
  */
@@ -153,6 +253,20 @@ glmFacetNormals(GLMmodel* model);
 GLvoid
 glmVertexNormals(GLMmodel* model, GLfloat angle);
 
+/* glmSmoothingAngle: Changes the smoothing angle of the vertex normals
+ * of a model, with the same result as glmVertexNormals() (but laid out
+ * differently: every vertex gets an average normal and one for each
+ * triangle it is in).  What the first call finds out is kept, so later
+ * calls only remake the normals of the vertices where the change of
+ * angle makes a difference.  Changing the triangles or the normals
+ * any other way starts it over.
+ *
+ * model - initialized GLMmodel structure
+ * angle - maximum angle (in degrees) to smooth across
+ */
+GLvoid
+glmSmoothingAngle(GLMmodel* model, GLfloat angle);
+
 /* glmLinearTexture: Generates texture coordinates according to a
  * linear projection of the texture map.  It generates these by
  * linearly mapping the vertices onto a square.
@@ -183,6 +297,14 @@ glmSpheremapTexture(GLMmodel* model);
 GLvoid
 glmDelete(GLMmodel* model);
 
+/* glmMemory: Returns the bytes of memory a model takes up (not
+ * counting what glmSmoothingAngle() keeps).
+ *
+ * model - initialized GLMmodel structure
+ */
+size_t
+glmMemory(GLMmodel* model);
+
 /* glmReadOBJ: Reads a model description from a Wavefront .OBJ file.
  * Returns a pointer to the created object which should be free'd with
  * glmDelete().
@@ -192,6 +314,77 @@ glmDelete(GLMmodel* model);
 GLMmodel* 
 glmReadOBJ(char* filename);
 
+/* glmReadOBJThreads: Reads a model description from a Wavefront .OBJ
+ * file, parsing newline aligned chunks of it on separate threads.
+ * The model is the same no matter how many threads are used; the
+ * thread count is kept in the model for later processing.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ */
+GLMmodel* 
+glmReadOBJThreads(char* filename, GLuint numthreads);
+
+/* GLMprogress: Callback that glmReadOBJProgress() tells about the
+ * bytes of the file it has parsed.
+ *
+ * data  - data given to glmReadOBJProgress()
+ * bytes - number of bytes parsed since the last call (from any thread)
+ * size  - size of the whole file in bytes
+ */
+typedef GLvoid (*GLMprogress)(GLvoid* data, size_t bytes, size_t size);
+
+/* glmReadOBJProgress: Reads a model description from a Wavefront .OBJ
+ * file like glmReadOBJThreads(), calling progress as parsing goes
+ * along.  As the file is parsed on several threads at once, progress
+ * may be called from any of them, at the same time.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ * progress   - callback told about bytes parsed
+ * data       - passed to progress
+ */
+GLMmodel* 
+glmReadOBJProgress(char* filename, GLuint numthreads, GLMprogress progress,
+                   GLvoid* data);
+
+/* GLMbatch: Structure that defines a batch of triangles handed out by
+ * glmReadOBJStream().
+ */
+typedef struct _GLMbatch {
+  GLuint   numtriangles;        /* number of triangles in the batch */
+  GLfloat* triangles;           /* facet normal and vertex of each corner
+                                   (GL_N3F_V3F, 18 floats a triangle), 
+                                   for the callback to free() */
+  GLfloat  min[3];              /* smallest coordinates of the vertices
+                                   read so far */
+  GLfloat  max[3];              /* largest coordinates of the vertices
+                                   read so far */
+  size_t   parsed;              /* bytes of the file parsed so far */
+  size_t   size;                /* bytes in the file */
+} GLMbatch;
+
+/* GLMstream: Callback glmReadOBJStream() hands batches to.
+ *
+ * data  - data given to glmReadOBJStream()
+ * batch - the triangles read since the last batch
+ */
+typedef GLvoid (*GLMstream)(GLvoid* data, GLMbatch* batch);
+
+/* glmReadOBJStream: Reads a model description from a Wavefront .OBJ
+ * file like glmReadOBJThreads(), handing the triangles read to stream
+ * in batches as it goes, so they can be shown before the whole file
+ * is read.  Returns the complete model (not unitized) at the end.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ * stream     - callback handed the batches (on the calling thread)
+ * data       - passed to stream
+ */
+GLMmodel* 
+glmReadOBJStream(char* filename, GLuint numthreads, GLMstream stream,
+                 GLvoid* data);
+
 /* glmWriteOBJ: Writes a model description in Wavefront .OBJ format to
  * a file.
  *
@@ -207,6 +400,75 @@ glmReadOBJ(char* filename);
 GLvoid
 glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode);
 
+/* glmReadPLY: Reads a model from a binary (little or big endian) PLY
+ * file.  The vertices (with their normals and texcoords, if they have
+ * nx/ny/nz and u/v properties) and the faces, split into triangles,
+ * are decoded straight out of the memory mapped file, all in one
+ * group named "default".  Returns a pointer to the created object
+ * which should be free'd with glmDelete().
+ *
+ * filename   - name of the file containing the PLY format data.
+ * numthreads - number of threads to use (0 = one per processor)
+ */
+GLMmodel*
+glmReadPLY(char* filename, GLuint numthreads);
+
+/* glmReadSTL: Reads a model from a binary STL file.  The corners of
+ * the triangles that are at the same position share a vertex, and
+ * they are all in one group named "default".  Returns a pointer to
+ * the created object which should be free'd with glmDelete().
+ *
+ * filename   - name of the file containing the STL format data.
+ * numthreads - number of threads the model uses later (0 = one per
+ *              processor)
+ */
+GLMmodel*
+glmReadSTL(char* filename, GLuint numthreads);
+
+/* glmWritePLY: Writes the vertices and triangles of a model to a
+ * binary (little endian) PLY file.
+ *
+ * model    - initialized GLMmodel structure
+ * filename - name of the file to write the PLY format data to
+ */
+GLvoid
+glmWritePLY(GLMmodel* model, char* filename);
+
+/* glmWriteSTL: Writes the triangles of a model to a binary STL file,
+ * along with their facet normals (zero if the model has none).
+ *
+ * model    - initialized GLMmodel structure
+ * filename - name of the file to write the STL format data to
+ */
+GLvoid
+glmWriteSTL(GLMmodel* model, char* filename);
+
+/* glmWriteCache: Writes a (fully processed) model into a binary
+ * cache file (.glmb) next to the Wavefront .OBJ file it was read from,
+ * so that glmReadCache() can map it back in without parsing anything.
+ * The cache is keyed by the path, size and modification time of the
+ * OBJ file, and by the smoothing angle of the vertex normals.
+ *
+ * model - initialized GLMmodel structure
+ * angle - smoothing angle glmVertexNormals() was called with
+ * scale - scale factor glmUnitize() returned (or 1.0)
+ */
+GLvoid
+glmWriteCache(GLMmodel* model, GLfloat angle, GLfloat scale);
+
+/* glmReadCache: Reads a model from the binary cache file written by
+ * glmWriteCache() next to a Wavefront .OBJ file.  The cache is memory
+ * mapped (copy-on-write) and used in place.  Returns NULL if there is
+ * no cache or it is stale, otherwise a pointer to the created object
+ * which should be free'd with glmDelete().
+ *
+ * filename - name of the Wavefront .OBJ file
+ * angle    - smoothing angle the vertex normals should be made with
+ * scale    - will contain the scale factor the model was unitized with
+ */
+GLMmodel*
+glmReadCache(char* filename, GLfloat angle, GLfloat* scale);
+
 /* glmDraw: Renders the model to the current OpenGL context using the
  * mode specified.
  *
@@ -221,6 +483,19 @@ glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode);
 GLvoid
 glmDraw(GLMmodel* model, GLuint mode);
 
+/* glmDrawStats: Counts the draw calls and material state changes
+ * glmDraw() and glmDrawBuffers() issue to render the model in the
+ * mode specified.  Groups are drawn sorted by material, and groups
+ * that look the same are drawn together with one material change.
+ *
+ * model    - initialized GLMmodel structure
+ * mode     - render mode (see glmDraw())
+ * draws    - set to the number of draw calls
+ * states   - set to the number of glMaterial()/glColor() calls
+ */
+GLvoid
+glmDrawStats(GLMmodel* model, GLuint mode, GLuint* draws, GLuint* states);
+
 /* glmList: Generates and returns a display list for the model using
  * the mode specified.
  *
@@ -235,6 +510,112 @@ glmDraw(GLMmodel* model, GLuint mode);
 GLuint
 glmList(GLMmodel* model, GLuint mode);
 
+/* glmBuffers: Generates and returns vertex and index buffer objects
+ * for the model using the mode specified, or NULL if the OpenGL
+ * implementation has no buffer objects.  Shared vertices are stored
+ * once, and the groups sharing a material are drawn with a single
+ * glDrawElements().
+ *
+ * model    - initialized GLMmodel structure
+ * mode     - a bitwise OR of values describing what is to be rendered
+ *            (see glmDraw()).
+ */
+GLMbuffers*
+glmBuffers(GLMmodel* model, GLuint mode);
+
+/* glmPrepareBuffers: Generates the contents of the buffer objects
+ * glmBuffers() would make, without making any GL calls.  Safe to call
+ * on any thread, several at once, so long as the model isn't being
+ * changed meanwhile.
+ *
+ * model    - initialized GLMmodel structure
+ * mode     - a bitwise OR of values describing what is to be rendered
+ *            (see glmDraw()).
+ */
+GLMbuffers*
+glmPrepareBuffers(GLMmodel* model, GLuint mode);
+
+/* glmUploadBuffers: Creates buffer objects in the current GL context
+ * for buffers generated by glmPrepareBuffers().  Call it on the thread
+ * the context is current on.  Returns GL_FALSE if the GL has no buffer
+ * objects.
+ *
+ * buffers - buffers generated by glmPrepareBuffers()
+ */
+GLboolean
+glmUploadBuffers(GLMbuffers* buffers);
+
+/* glmDrawBuffers: Renders buffer objects generated by glmBuffers().
+ *
+ * buffers - buffers generated by glmBuffers()
+ */
+GLvoid
+glmDrawBuffers(GLMbuffers* buffers);
+
+/* glmDeleteBuffers: Deletes buffers generated by glmBuffers() or
+ * glmPrepareBuffers().
+ *
+ * buffers - buffers generated by glmBuffers() or glmPrepareBuffers()
+ */
+GLvoid
+glmDeleteBuffers(GLMbuffers* buffers);
+
+/* glmCompact: Returns a compact copy of a model (which can then be
+ * deleted).  Its triangles are put in group order, so each group is a
+ * range of them, and only the indices the model has are kept: in
+ * blocks that take 16 bits an index when their indices are close
+ * enough together.  Should be free'd with glmDeleteCompact().
+ *
+ * model - initialized GLMmodel structure
+ */
+GLMcompact*
+glmCompact(GLMmodel* model);
+
+/* glmCompactTriangle: Gets the indices of a triangle of a compact
+ * model.
+ *
+ * compact  - compact model
+ * i        - index of the triangle
+ * vindices - will hold its 3 vertex indices
+ * nindices - will hold its 3 normal indices (0 if none; may be NULL)
+ * tindices - will hold its 3 texcoord indices (0 if none; may be NULL)
+ */
+GLvoid
+glmCompactTriangle(GLMcompact* compact, GLuint i, GLuint* vindices,
+                   GLuint* nindices, GLuint* tindices);
+
+/* glmDrawCompact: Renders a compact model like glmDraw().
+ *
+ * compact - compact model
+ * mode    - render mode (see glmDraw())
+ */
+GLvoid
+glmDrawCompact(GLMcompact* compact, GLuint mode);
+
+/* glmListCompact: Generates and returns a display list for a compact
+ * model like glmList().
+ *
+ * compact - compact model
+ * mode    - render mode (see glmDraw())
+ */
+GLuint
+glmListCompact(GLMcompact* compact, GLuint mode);
+
+/* glmCompactMemory: Returns the bytes of memory a compact model takes
+ * up.
+ *
+ * compact - compact model
+ */
+size_t
+glmCompactMemory(GLMcompact* compact);
+
+/* glmDeleteCompact: Deletes a compact model.
+ *
+ * compact - compact model
+ */
+GLvoid
+glmDeleteCompact(GLMcompact* compact);
+
 /* glmWeld: eliminate (weld) vectors that are within an epsilon of
  * each other.
  *
@@ -1,21 +1,37 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include <sys/timeb.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 #include <GL/glut.h>
 
 #include "gltb.h"
 #include "glm.h"
 #include "dirent32.h"
+#include "pthread32.h"
 
 #define DATA_DIR "data/"
 #define CLK_TCK 1000
+#define NUM_MODES 6     /* smooth/flat times none/color/material */
 
 char*      model_file = NULL;		/* name of the obect file */
-GLuint     model_list = 0;		    /* display list for object */
+GLuint     model_lists[NUM_MODES];	/* display lists for object, by mode */
+GLMbuffers* model_buffers[NUM_MODES];	/* buffer objects for object, by mode */
+GLuint     model_mode = 0;		    /* index of the current render mode */
+GLuint     model_draws[NUM_MODES];	/* draw calls, by mode */
+GLuint     model_states[NUM_MODES];	/* material changes, by mode */
+GLboolean  use_buffers = GL_FALSE;	/* draw with buffer objects? */
+GLboolean  streaming = GL_FALSE;	/* show models while they load? */
 GLMmodel*  model;			        /* glm model data structure */
+GLMcompact* compact = NULL;		/* compact form of it (instead) */
+GLboolean  compacting = GL_FALSE;	/* keep models in compact form? */
 GLfloat    scale;			        /* original scale factor */
 GLfloat    smoothing_angle = 90.0;	/* smoothing angle */
 GLfloat    weld_distance = 0.00001;	/* epsilon for welding vertices */
@@ -25,10 +41,37 @@ GLboolean  performance = GL_FALSE;	/* performance counter on? */
 GLboolean  stats = GL_FALSE;		/* statistics on? */
 GLuint     material_mode = 0;		/* 0=none, 1=color, 2=material */
 GLint      entries = 0;			    /* entries in model menu */
+GLuint     num_threads = 0;		    /* loader threads (0 = one per cpu) */
+GLint      bench_vertices = 0;		/* vertices in synthetic bench model */
 GLdouble   pan_x = 0.0;
 GLdouble   pan_y = 0.0;
 GLdouble   pan_z = 0.0;
 
+/* a model being read on a worker thread (see loadstart()) */
+typedef struct _Loader {
+    char*      filename;		/* file being read */
+    GLfloat    angle;			    /* smoothing angle for its normals */
+    GLMmodel*  model;			    /* the model, once it has been read */
+    GLfloat    scale;			    /* its original scale factor */
+    size_t     parsed;			    /* bytes of the file parsed so far */
+    size_t     size;			    /* bytes in the file */
+    GLboolean  done;			    /* has the thread finished? */
+    GLMbatch*  batches;			/* batches streamed in, not yet in lists */
+    GLuint     numbatches;		/* number of batches */
+    pthread_mutex_t lock;		/* guards the above */
+    pthread_t  thread;
+    GLboolean  stream;			/* stream the model in? */
+    GLuint*    lists;			/* display lists of the batches so far */
+    GLuint     numlists;		/* number of lists */
+    GLfloat    min[3];			/* bounds of the vertices so far */
+    GLfloat    max[3];
+    double     start;			/* when loading started */
+    double     first;			/* when streamed triangles were first
+                                   on screen (0 = not yet) */
+} Loader;
+
+Loader*    loader = NULL;		    /* model being loaded (or NULL) */
+
 float elapsed(void)
 {
     static long begin = 0;
@@ -44,6 +87,15 @@ float elapsed(void)
     return (float)difference/(float)CLK_TCK;
 }
 
+/* the time in seconds (unlike elapsed(), safe to use on any thread) */
+double seconds(void)
+{
+    struct timeb tb;
+
+    ftime(&tb);
+    return tb.time + tb.millitm / 1000.0;
+}
+
 void shadowtext(int x, int y, char* s)
 {
     int lines;
@@ -89,52 +141,327 @@ void lists(void)
     GLfloat diffuse[] = { 0.8, 0.8, 0.8, 1.0 };
     GLfloat specular[] = { 0.0, 0.0, 0.0, 1.0 };
     GLfloat shininess = 65.0;
+    GLuint mode;
 
     glMaterialfv(GL_FRONT, GL_AMBIENT, ambient);
     glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
     glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
     glMaterialf(GL_FRONT, GL_SHININESS, shininess);
 
-    if (model_list)
-        glDeleteLists(model_list, 1);
+    mode = facet_normal ? GLM_FLAT : GLM_SMOOTH;
+    if (material_mode == 1)
+        mode |= GLM_COLOR;
+    else if (material_mode == 2)
+        mode |= GLM_MATERIAL;
+    model_mode = 2 * material_mode + (facet_normal ? 1 : 0);
+
+    /* a compact model only draws from lists */
+    if (compact) {
+        if (!model_lists[model_mode])
+            model_lists[model_mode] = glmListCompact(compact, mode);
+        return;
+    }
 
-    /* generate a list */
-    if (material_mode == 0) {
-        if (facet_normal)
-            model_list = glmList(model, GLM_FLAT);
-        else
-            model_list = glmList(model, GLM_SMOOTH);
+    /* generate buffer objects (if asked for and there are any) or a
+       list for this mode, unless there is one from before */
+    if (!model_lists[model_mode] && !model_buffers[model_mode])
+        glmDrawStats(model, mode, 
+            &model_draws[model_mode], &model_states[model_mode]);
+    if (use_buffers && !model_buffers[model_mode]) {
+        model_buffers[model_mode] = glmBuffers(model, mode);
+        if (!model_buffers[model_mode]) {
+            printf("No buffer objects, using a display list\n");
+            use_buffers = GL_FALSE;
+        }
     }
-	else if (material_mode == 1) {
-        if (facet_normal)
-            model_list = glmList(model, GLM_FLAT | GLM_COLOR);
-        else
-            model_list = glmList(model, GLM_SMOOTH | GLM_COLOR);
+    if (!use_buffers && !model_lists[model_mode])
+        model_lists[model_mode] = glmList(model, mode);
+}
+
+/* throw away the lists and buffer objects made from the model, or
+   only the smooth shaded ones if just the vertex normals changed */
+void invalidate(GLboolean smooth_only)
+{
+    GLuint i;
+
+    for (i = 0; i < NUM_MODES; i++) {
+        if (smooth_only && i % 2 == 1)
+            continue;
+        if (model_lists[i])
+            glDeleteLists(model_lists[i], 1);
+        model_lists[i] = 0;
+        if (model_buffers[i])
+            glmDeleteBuffers(model_buffers[i]);
+        model_buffers[i] = NULL;
     }
-	else if (material_mode == 2) {
-        if (facet_normal)
-            model_list = glmList(model, GLM_FLAT | GLM_MATERIAL);
-        else
-            model_list = glmList(model, GLM_SMOOTH | GLM_MATERIAL);
+}
+
+/* swap the model for its compact form, reporting the memory saved */
+void compactmodel(void)
+{
+    size_t before;
+
+    before = glmMemory(model);
+    compact = glmCompact(model);
+    printf("%s takes %.1f MB, %.1f MB compact\n", model->pathname,
+        before / 1048576.0, glmCompactMemory(compact) / 1048576.0);
+
+    invalidate(GL_FALSE);
+    glmDelete(model);
+    model = NULL;
+}
+
+/* read in a model, from its cache if there is an up to date one,
+   otherwise from the OBJ file (caching the result for next time).
+   Changes no globals, so it can run on a worker thread. */
+GLMmodel* load(char* filename, GLfloat angle, GLfloat* factor,
+               GLMprogress progress, GLMstream stream, GLvoid* data)
+{
+    GLMmodel* m;
+    double start;
+
+    start = seconds();
+    m = glmReadCache(filename, angle, factor);
+    if (m) {
+        printf("Read %s from cache in %.3f seconds\n", filename,
+            seconds() - start);
+        return m;
     }
+
+    if (stream)
+        m = glmReadOBJStream(filename, num_threads, stream, data);
+    else
+        m = glmReadOBJProgress(filename, num_threads, progress, data);
+    printf("Read %s in %.3f seconds\n", filename, seconds() - start);
+    *factor = glmUnitize(m);
+    glmFacetNormals(m);
+    glmVertexNormals(m, angle);
+    glmWriteCache(m, angle, *factor);
+
+    return m;
 }
 
-void init(void)
+/* GLMprogress callback of a loader (called on parsing threads) */
+void loadprogress(GLvoid* data, size_t bytes, size_t size)
 {
-    gltbInit(GLUT_LEFT_BUTTON);
+    Loader* l = (Loader*)data;
+
+    pthread_mutex_lock(&l->lock);
+    l->parsed += bytes;
+    l->size = size;
+    pthread_mutex_unlock(&l->lock);
+}
+
+/* GLMstream callback of a loader (called on its thread) */
+void loadbatch(GLvoid* data, GLMbatch* batch)
+{
+    Loader* l = (Loader*)data;
+
+    pthread_mutex_lock(&l->lock);
+    l->batches = (GLMbatch*)realloc(l->batches, 
+        sizeof(GLMbatch) * (l->numbatches + 1));
+    l->batches[l->numbatches++] = *batch;
+    l->parsed = batch->parsed;
+    l->size = batch->size;
+    pthread_mutex_unlock(&l->lock);
+}
+
+/* worker thread of a loader */
+void* loadthread(void* data)
+{
+    Loader* l = (Loader*)data;
+    GLMmodel* m;
+
+    m = load(l->filename, l->angle, &l->scale, loadprogress, 
+        l->stream ? loadbatch : NULL, l);
+
+    pthread_mutex_lock(&l->lock);
+    l->model = m;
+    l->done = GL_TRUE;
+    pthread_mutex_unlock(&l->lock);
+
+    return NULL;
+}
+
+/* compile the batches a loader has streamed in since last time into
+   display lists of their own */
+void loadlists(void)
+{
+    GLMbatch* batches;
+    GLuint numbatches, i;
+
+    pthread_mutex_lock(&loader->lock);
+    batches = loader->batches;
+    numbatches = loader->numbatches;
+    loader->batches = NULL;
+    loader->numbatches = 0;
+    pthread_mutex_unlock(&loader->lock);
+
+    if (!numbatches)
+        return;
+
+    loader->lists = (GLuint*)realloc(loader->lists, 
+        sizeof(GLuint) * (loader->numlists + numbatches));
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    for (i = 0; i < numbatches; i++) {
+        if (batches[i].numtriangles) {
+            loader->lists[loader->numlists] = glGenLists(1);
+            glNewList(loader->lists[loader->numlists++], GL_COMPILE);
+            glInterleavedArrays(GL_N3F_V3F, 0, batches[i].triangles);
+            glDrawArrays(GL_TRIANGLES, 0, 3 * batches[i].numtriangles);
+            glEndList();
+        }
+        free(batches[i].triangles);
+    }
+    glPopClientAttrib();
 
-    /* read in the model */
-    model = glmReadOBJ(model_file);
-    scale = glmUnitize(model);
-    glmFacetNormals(model);
-    glmVertexNormals(model, smoothing_angle);
+    /* the bounds that go with the lists */
+    memcpy(loader->min, batches[numbatches - 1].min, sizeof(GLfloat) * 3);
+    memcpy(loader->max, batches[numbatches - 1].max, sizeof(GLfloat) * 3);
+    free(batches);
+}
+
+/* draw what a loader has streamed in so far, unitized (like
+   glmUnitize()) by the bounds of the vertices read so far */
+void loaddraw(void)
+{
+    GLfloat ambient[] = { 0.2, 0.2, 0.2, 1.0 };
+    GLfloat diffuse[] = { 0.8, 0.8, 0.8, 1.0 };
+    GLfloat dimension;
+    GLuint i;
+
+    dimension = 0.0;
+    for (i = 0; i < 3; i++)
+        if (dimension < loader->max[i] - loader->min[i])
+            dimension = loader->max[i] - loader->min[i];
+    if (dimension <= 0.0)
+        return;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_LIGHTING_BIT);
+    glDisable(GL_COLOR_MATERIAL);
+    glEnable(GL_NORMALIZE);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
+    glPushMatrix();
+    glScalef(2.0 / dimension, 2.0 / dimension, 2.0 / dimension);
+    glTranslatef(-(loader->max[0] + loader->min[0]) / 2.0,
+                 -(loader->max[1] + loader->min[1]) / 2.0,
+                 -(loader->max[2] + loader->min[2]) / 2.0);
+    for (i = 0; i < loader->numlists; i++)
+        glCallList(loader->lists[i]);
+    glPopMatrix();
+    glPopAttrib();
+}
+
+/* swap in the model a loader has finished reading, and free the one
+   it replaces (along with its lists and buffers) */
+void loadfinish(void)
+{
+    GLuint i;
+
+    pthread_mutex_destroy(&loader->lock);
+
+    if (loader->first)
+        printf("Loaded %s in %.3f seconds (first frame after %.3f)\n", 
+            loader->filename, seconds() - loader->start, 
+            loader->first - loader->start);
+    else
+        printf("Loaded %s in %.3f seconds\n", loader->filename,
+            seconds() - loader->start);
+
+    /* the streamed in batches, drawn or not */
+    for (i = 0; i < loader->numlists; i++)
+        glDeleteLists(loader->lists[i], 1);
+    free(loader->lists);
+    for (i = 0; i < loader->numbatches; i++)
+        free(loader->batches[i].triangles);
+    free(loader->batches);
+
+    invalidate(GL_FALSE);
+    if (model)
+        glmDelete(model);
+    if (compact)
+        glmDeleteCompact(compact);
+    compact = NULL;
+    model = loader->model;
+    scale = loader->scale;
 
     if (model->nummaterials > 0)
         material_mode = 2;
-
-    /* create new display lists */
+    else
+        material_mode = 0;
+    if (compacting)
+        compactmodel();
     lists();
 
+    free(loader->filename);
+    free(loader);
+    loader = NULL;
+}
+
+/* see if the loader is done (every so often while it isn't) */
+void loadpoll(int value)
+{
+    GLboolean done;
+
+    pthread_mutex_lock(&loader->lock);
+    done = loader->done;
+    pthread_mutex_unlock(&loader->lock);
+
+    if (done) {
+        pthread_join(loader->thread, NULL);
+        loadfinish();
+    } else {
+        loadlists();
+        glutTimerFunc(100, loadpoll, 0);
+    }
+    glutPostRedisplay();
+}
+
+/* start reading a model on a worker thread; the current one keeps
+   being drawn until the new one is ready (or, when streaming, until
+   the first of the new one's triangles are) */
+void loadstart(char* filename)
+{
+    if (loader) {
+        printf("Still loading %s\n", loader->filename);
+        return;
+    }
+
+    loader = (Loader*)calloc(1, sizeof(Loader));
+    loader->filename = strdup(filename);
+    loader->angle = smoothing_angle;
+    loader->stream = streaming;
+    loader->start = seconds();
+    pthread_mutex_init(&loader->lock, NULL);
+    if (pthread_create(&loader->thread, NULL, loadthread, loader)) {
+        /* no thread, so read it here */
+        loadthread(loader);
+        loadfinish();
+        return;
+    }
+    glutTimerFunc(100, loadpoll, 0);
+}
+
+void init(void)
+{
+    gltbInit(GLUT_LEFT_BUTTON);
+
+    /* read in the model (or start streaming it in) */
+    if (streaming) {
+        loadstart(model_file);
+    } else {
+        model = load(model_file, smoothing_angle, &scale, NULL, NULL, NULL);
+
+        if (model->nummaterials > 0)
+            material_mode = 2;
+        if (compacting)
+            compactmodel();
+
+        /* create new display lists */
+        lists();
+    }
+
     glEnable(GL_LIGHTING);
     glEnable(GL_LIGHT0);
     glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
@@ -161,7 +488,7 @@ void reshape(int width, int height)
 #define NUM_FRAMES 5
 void display(void)
 {
-    static char s[256], t[32];
+    static char s[512], t[32];
     static char* p;
     static int frames = 0;
 
@@ -192,7 +519,12 @@ void display(void)
             glmDraw(model, GLM_SMOOTH | GLM_MATERIAL);
     }
 #else
-    glCallList(model_list);
+    if (loader && loader->numlists)
+        loaddraw();
+    else if (model && use_buffers)
+        glmDrawBuffers(model_buffers[model_mode]);
+    else if (model || compact)
+        glCallList(model_lists[model_mode]);
 #endif
 
     glDisable(GL_LIGHTING);
@@ -207,36 +539,73 @@ void display(void)
 
     glPopMatrix();
 
-    if (stats) {
+    if (stats && model) {
         /* XXX - this could be done a _whole lot_ faster... */
         int height = glutGet(GLUT_WINDOW_HEIGHT);
         glColor3ub(0, 0, 0);
         sprintf(s, "%s\n%d vertices\n%d triangles\n%d normals\n"
-            "%d texcoords\n%d groups\n%d materials",
+            "%d texcoords\n%d groups\n%d materials\n%d draws\n"
+            "%d state changes\n%.1f MB",
             model->pathname, model->numvertices, model->numtriangles,
             model->numnormals, model->numtexcoords, model->numgroups,
-            model->nummaterials);
+            model->nummaterials, model_draws[model_mode], 
+            model_states[model_mode], glmMemory(model) / 1048576.0);
+        shadowtext(5, height-(5+18*1), s);
+    } else if (stats && compact) {
+        int height = glutGet(GLUT_WINDOW_HEIGHT);
+        sprintf(s, "%s\n%d vertices\n%d triangles\n%d normals\n"
+            "%d texcoords\n%d groups\n%d materials\n%.1f MB (compact)",
+            compact->pathname, compact->numvertices, compact->numtriangles,
+            compact->numnormals, compact->numtexcoords, compact->numgroups,
+            compact->nummaterials, glmCompactMemory(compact) / 1048576.0);
         shadowtext(5, height-(5+18*1), s);
     }
 
     /* spit out frame rate. */
     frames++;
     if (frames > NUM_FRAMES) {
-        sprintf(t, "%g fps", frames/elapsed());
+        sprintf(t, "%g fps (%s)", frames/elapsed(),
+            use_buffers ? "buffers" : "list");
         frames = 0;
     }
     if (performance) {
         shadowtext(5, 5, t);
     }
 
+    /* show how far along a model being loaded is */
+    if (loader) {
+        int height = glutGet(GLUT_WINDOW_HEIGHT);
+        pthread_mutex_lock(&loader->lock);
+        if (loader->size && loader->parsed < loader->size)
+            sprintf(s, "Loading %s: %.1f of %.1f MB", loader->filename,
+                loader->parsed / 1048576.0, loader->size / 1048576.0);
+        else
+            sprintf(s, "Loading %s", loader->filename);
+        pthread_mutex_unlock(&loader->lock);
+        shadowtext(5, height-(5+18*(stats ? 11 : 1)), s);
+    }
+
     glutSwapBuffers();
     glEnable(GL_LIGHTING);
+
+    if (loader && loader->numlists && !loader->first) {
+        loader->first = seconds();
+        printf("First frame of %s after %.3f seconds\n", loader->filename,
+            loader->first - loader->start);
+    }
 }
 
 void keyboard(unsigned char key, int x, int y)
 {
     GLint params[2];
 
+    /* nothing to change before the first model is in, and only how it
+       is drawn once it is compact */
+    if (!model && strchr("vdrsSoO-+WR", key))
+        return;
+    if (!model && !compact && strchr("mn", key))
+        return;
+
     switch (key) {
     case 'h':
         printf("help\n\n");
@@ -247,6 +616,9 @@ void keyboard(unsigned char key, int x, int y)
         printf("r         -  Reverse polygon winding\n");
         printf("m         -  Toggle color/material/none mode\n");
         printf("p         -  Toggle performance indicator\n");
+        printf("v         -  Toggle display list/buffer objects\n");
+        printf("l         -  Toggle streaming model loads\n");
+        printf("k         -  Toggle compact model storage\n");
         printf("s/S       -  Scale model smaller/larger\n");
         printf("t         -  Show model stats\n");
         printf("o         -  Weld vertices in model\n");
@@ -263,6 +635,29 @@ void keyboard(unsigned char key, int x, int y)
         performance = !performance;
         break;
 
+    case 'v':
+        use_buffers = !use_buffers;
+        lists();
+        printf("Drawing with %s\n", 
+            use_buffers ? "buffer objects" : "a display list");
+        break;
+
+    case 'l':
+        streaming = !streaming;
+        printf("Streaming loads %s\n", streaming ? "on" : "off");
+        break;
+
+    case 'k':
+        compacting = !compacting;
+        if (compacting && model) {
+            compactmodel();
+            lists();
+        } else if (!compacting && compact) {
+            /* the full model has to be read again */
+            loadstart(compact->pathname);
+        }
+        break;
+
     case 'm':
         material_mode++;
         if (material_mode > 2)
@@ -272,9 +667,10 @@ void keyboard(unsigned char key, int x, int y)
         break;
 
     case 'd':
+        invalidate(GL_FALSE);
         glmDelete(model);
+        model = NULL;
         init();
-        lists();
         break;
 
     case 'w':
@@ -303,22 +699,26 @@ void keyboard(unsigned char key, int x, int y)
 
     case 'r':
         glmReverseWinding(model);
+        invalidate(GL_FALSE);
         lists();
         break;
 
     case 's':
         glmScale(model, 0.8);
+        invalidate(GL_FALSE);
         lists();
         break;
 
     case 'S':
         glmScale(model, 1.25);
+        invalidate(GL_FALSE);
         lists();
         break;
 
     case 'o':
         //printf("Welded %d\n", glmWeld(model, weld_distance));
         glmVertexNormals(model, smoothing_angle);
+        invalidate(GL_TRUE);
         lists();
         break;
 
@@ -328,20 +728,23 @@ void keyboard(unsigned char key, int x, int y)
         glmWeld(model, weld_distance);
         glmFacetNormals(model);
         glmVertexNormals(model, smoothing_angle);
+        invalidate(GL_FALSE);
         lists();
         break;
 
     case '-':
         smoothing_angle -= 1.0;
         printf("Smoothing angle: %.1f\n", smoothing_angle);
-        glmVertexNormals(model, smoothing_angle);
+        glmSmoothingAngle(model, smoothing_angle);
+        invalidate(GL_TRUE);
         lists();
         break;
 
     case '+':
         smoothing_angle += 1.0;
         printf("Smoothing angle: %.1f\n", smoothing_angle);
-        glmVertexNormals(model, smoothing_angle);
+        glmSmoothingAngle(model, smoothing_angle);
+        invalidate(GL_TRUE);
         lists();
         break;
 
@@ -360,6 +763,7 @@ void keyboard(unsigned char key, int x, int y)
                 model->vertices[3 * i + 2] = -swap;
             }
             glmFacetNormals(model);
+            invalidate(GL_FALSE);
             lists();
             break;
         }
@@ -395,17 +799,7 @@ void menu(int item)
         name = (char*)malloc(strlen(direntp->d_name) + strlen(DATA_DIR) + 1);
         strcpy(name, DATA_DIR);
         strcat(name, direntp->d_name);
-        model = glmReadOBJ(name);
-        scale = glmUnitize(model);
-        glmFacetNormals(model);
-        glmVertexNormals(model, smoothing_angle);
-
-        if (model->nummaterials > 0)
-            material_mode = 2;
-        else
-            material_mode = 0;
-
-        lists();
+        loadstart(name);
         free(name);
 
         glutPostRedisplay();
@@ -470,27 +864,274 @@ void motion(int x, int y)
     glutPostRedisplay();
 }
 
+#define BENCH_RUNS 3
+#define BENCH_FILE "bench.obj"
+#define BENCH_OUTPUT "bench_out.obj"
+#define BENCH_REPEAT 10
+#define BENCH_CYCLES 20
+
+/* benchthreads: formats a thread count for the bench output */
+char* benchthreads(char* count, GLuint threads)
+{
+    if (threads)
+        sprintf(count, "%u", threads);
+    else
+        strcpy(count, "all");
+    return count;
+}
+
+/* benchread: reads a model a few times and reports the best time and
+   throughput */
+void benchread(char* filename, GLuint threads)
+{
+    struct stat info;
+    GLMmodel* m;
+    float t, best;
+    char count[16];
+    int i;
+
+    if (stat(filename, &info) < 0) {
+        fprintf(stderr, "bench: can't stat \"%s\".\n", filename);
+        return;
+    }
+
+    best = 0.0;
+    for (i = 0; i < BENCH_RUNS; i++) {
+        elapsed();
+        m = glmReadOBJThreads(filename, threads);
+        t = elapsed();
+        glmDelete(m);
+        if (i == 0 || t < best)
+            best = t;
+    }
+    if (best < 0.001)
+        best = 0.001;
+
+    printf("read   %-20s %3s threads %8.3f s %8.1f MB/s\n", filename,
+        benchthreads(count, threads), best, 
+        info.st_size / (1024.0 * 1024.0) / best);
+}
+
+/* peakrss: the most memory the process has had resident, in MB (0 if
+   there's no telling) */
+double peakrss(void)
+{
+#ifndef _WIN32
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#else
+    return 0.0;
+#endif
+}
+
+/* benchcycles: reads a model (with normals, as the viewer does) and
+   deletes it over and over, like reloading it does, and reports the
+   average time of each and the peak memory use */
+void benchcycles(char* filename)
+{
+    GLMmodel* m;
+    float read, erase;
+    int i;
+
+    read = erase = 0.0;
+    for (i = 0; i < BENCH_CYCLES; i++) {
+        elapsed();
+        m = glmReadOBJ(filename);
+        glmFacetNormals(m);
+        glmVertexNormals(m, smoothing_angle);
+        read += elapsed();
+        glmDelete(m);
+        erase += elapsed();
+    }
+
+    printf("cycle  %-20s %8.4f s read %8.4f s delete %8.1f MB peak\n",
+        filename, read / BENCH_CYCLES, erase / BENCH_CYCLES, peakrss());
+}
+
+/* benchmemory: reports the memory a model (with normals, as the viewer
+   has it) takes up, and how much it takes in compact form */
+void benchmemory(char* filename)
+{
+    GLMmodel* m;
+    GLMcompact* c;
+
+    m = glmReadOBJ(filename);
+    glmFacetNormals(m);
+    glmVertexNormals(m, smoothing_angle);
+    c = glmCompact(m);
+
+    printf("memory %-20s %8.1f MB %8.1f MB compact\n", filename,
+        glmMemory(m) / 1048576.0, glmCompactMemory(c) / 1048576.0);
+    glmDeleteCompact(c);
+    glmDelete(m);
+}
+
+/* benchfacets: makes the facet normals of a model a few times and
+   reports the best time and throughput */
+void benchfacets(char* filename, GLuint threads)
+{
+    GLMmodel* m;
+    float t, best;
+    char count[16];
+    int i, j;
+
+    m = glmReadOBJThreads(filename, 0);
+    m->numthreads = threads;
+    glmFacetNormals(m);
+
+    /* it's quick, so time a few at once */
+    best = 0.0;
+    for (i = 0; i < BENCH_RUNS; i++) {
+        elapsed();
+        for (j = 0; j < BENCH_REPEAT; j++)
+            glmFacetNormals(m);
+        t = elapsed() / BENCH_REPEAT;
+        if (i == 0 || t < best)
+            best = t;
+    }
+    if (best < 0.0001)
+        best = 0.0001;
+
+    printf("facets %-20s %3s threads %8.4f s %8.1f Mtris/s\n", filename,
+        benchthreads(count, threads), best, m->numtriangles / 1e6 / best);
+    glmDelete(m);
+}
+
+/* benchwrite: writes a model (with normals) out a few times and
+   reports the best time and throughput */
+void benchwrite(char* filename, GLuint threads)
+{
+    struct stat info;
+    GLMmodel* m;
+    float t, best;
+    char count[16];
+    int i;
+
+    m = glmReadOBJThreads(filename, 0);
+    m->numthreads = threads;
+    glmFacetNormals(m);
+    glmVertexNormals(m, smoothing_angle);
+
+    best = 0.0;
+    for (i = 0; i < BENCH_RUNS; i++) {
+        elapsed();
+        glmWriteOBJ(m, BENCH_OUTPUT, GLM_SMOOTH);
+        t = elapsed();
+        if (i == 0 || t < best)
+            best = t;
+    }
+    if (best < 0.001)
+        best = 0.001;
+    glmDelete(m);
+
+    if (stat(BENCH_OUTPUT, &info) < 0) {
+        fprintf(stderr, "bench: can't stat \"%s\".\n", BENCH_OUTPUT);
+        return;
+    }
+    remove(BENCH_OUTPUT);
+
+    printf("write  %-20s %3s threads %8.3f s %8.1f MB/s\n", filename,
+        benchthreads(count, threads), best,
+        info.st_size / (1024.0 * 1024.0) / best);
+}
+
+/* bench: times reading and deleting, the reader, facet normals and the
+   writer on the given model (and reports its memory use), then the
+   reader, facet normals and writer on a synthetic grid of the given
+   number of vertices, then quits */
+void bench(char* filename, int vertices)
+{
+    FILE* file;
+    int n, i, j;
+
+    benchcycles(filename);
+    benchmemory(filename);
+    benchread(filename, 1);
+    benchread(filename, 0);
+    benchfacets(filename, 1);
+    benchfacets(filename, 0);
+    benchwrite(filename, 1);
+    benchwrite(filename, 0);
+
+    /* write out the grid (two triangles per cell) */
+    n = (int)sqrt((double)vertices);
+    file = fopen(BENCH_FILE, "w");
+    if (!file) {
+        fprintf(stderr, "bench: can't write \"%s\".\n", BENCH_FILE);
+        return;
+    }
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            fprintf(file, "v %f %f %f\n", (float)i / n, (float)j / n,
+                0.1 * sin(i * 0.1) * cos(j * 0.1));
+    for (i = 0; i < n - 1; i++) {
+        for (j = 0; j < n - 1; j++) {
+            fprintf(file, "f %d %d %d\n", i*n+j+1, (i+1)*n+j+1, i*n+j+2);
+            fprintf(file, "f %d %d %d\n", i*n+j+2, (i+1)*n+j+1, (i+1)*n+j+2);
+        }
+    }
+    fclose(file);
+
+    benchread(BENCH_FILE, 1);
+    benchread(BENCH_FILE, 0);
+    benchfacets(BENCH_FILE, 1);
+    benchfacets(BENCH_FILE, 0);
+    benchwrite(BENCH_FILE, 1);
+    benchwrite(BENCH_FILE, 0);
+
+    remove(BENCH_FILE);
+}
+
 int main(int argc, char** argv)
 {
     int buffering = GLUT_DOUBLE;
     struct dirent* direntp;
     DIR* dirp;
     int models;
+    int i;
 
-    glutInitWindowSize(512, 512);
-    glutInit(&argc, argv);
+    /* a benchmark doesn't need a window (or even a display) */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-bench") == 0)
+            bench_vertices = 10000000;
+    }
+    if (!bench_vertices) {
+        glutInitWindowSize(512, 512);
+        glutInit(&argc, argv);
+    }
 
-    while (--argc) {
-        if (strcmp(argv[argc], "-sb") == 0)
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-sb") == 0)
             buffering = GLUT_SINGLE;
+        else if (strcmp(argv[i], "-stream") == 0)
+            streaming = GL_TRUE;
+        else if (strcmp(argv[i], "-compact") == 0)
+            compacting = GL_TRUE;
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-bench") == 0) {
+            if (i + 1 < argc && isdigit(argv[i + 1][0]))
+                bench_vertices = atoi(argv[++i]);
+        }
         else
-            model_file = argv[argc];
+            model_file = argv[i];
     }
 
     if (!model_file) {
         model_file = "data/bunny.obj";
     }
 
+    if (bench_vertices) {
+        bench(model_file, bench_vertices);
+        return 0;
+    }
+
     glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | buffering);
     glutCreateWindow("Smooth");
 
@@ -524,6 +1165,9 @@ int main(int argc, char** argv)
     glutAddMenuEntry("[n]   Toggle face/smooth normals", 'n');
     glutAddMenuEntry("[b]   Toggle bounding box on/off", 'b');
     glutAddMenuEntry("[p]   Toggle frame rate on/off", 'p');
+    glutAddMenuEntry("[v]   Toggle display list/buffer objects", 'v');
+    glutAddMenuEntry("[l]   Toggle streaming model loads", 'l');
+    glutAddMenuEntry("[k]   Toggle compact model storage", 'k');
     glutAddMenuEntry("[t]   Toggle model statistics", 't');
     glutAddMenuEntry("[m]   Toggle color/material/none mode", 'm');
     glutAddMenuEntry("[r]   Reverse polygon winding", 'r');
@@ -0,0 +1,79 @@
+/*
+
+    Win32 lacks unix mmap support.  But, we can fake it with file
+    mappings.  Only what glm needs is here: read-only or private
+    (copy-on-write) mappings of a whole file from offset 0.
+
+ */
+
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+
+#include <io.h>
+#include <windows.h>
+
+
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_FAILED    ((void*)-1)
+
+
+static void *
+mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    HANDLE file, mapping;
+    DWORD  protect, access;
+    void*  view;
+
+    if (offset != 0 || length == 0)
+        return MAP_FAILED;
+
+    file = (HANDLE)_get_osfhandle(fd);
+    if (file == INVALID_HANDLE_VALUE)
+        return MAP_FAILED;
+
+    /* a private writable mapping is copy-on-write, so the file itself
+       is never touched */
+    if ((prot & PROT_WRITE) && (flags & MAP_PRIVATE)) {
+        protect = PAGE_WRITECOPY;
+        access = FILE_MAP_COPY;
+    } else if (prot & PROT_WRITE) {
+        protect = PAGE_READWRITE;
+        access = FILE_MAP_WRITE;
+    } else {
+        protect = PAGE_READONLY;
+        access = FILE_MAP_READ;
+    }
+
+    mapping = CreateFileMapping(file, NULL, protect, 0, 0, NULL);
+    if (!mapping)
+        return MAP_FAILED;
+    view = MapViewOfFile(mapping, access, 0, 0, length);
+
+    /* the view keeps a reference to the mapping object */
+    CloseHandle(mapping);
+
+    return view ? view : MAP_FAILED;
+}
+
+
+static int
+munmap(void *addr, size_t length)
+{
+    return UnmapViewOfFile(addr) ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+
+    Win32 lacks POSIX threads.  But, we can fake the handful of
+    pthread calls glm and the viewer use on top of native threads,
+    critical sections and condition variables (Vista or later).
+
+ */
+
+
+#ifndef _WIN32
+#include <pthread.h>
+#else
+
+#include <windows.h>
+#include <process.h>
+
+
+typedef HANDLE             pthread_t;
+typedef CRITICAL_SECTION   pthread_mutex_t;
+typedef CONDITION_VARIABLE pthread_cond_t;
+typedef void               pthread_attr_t;
+typedef void               pthread_mutexattr_t;
+typedef void               pthread_condattr_t;
+
+typedef struct {
+    void* (*routine)(void*);
+    void* arg;
+} pthread32_start_t;
+
+
+static unsigned __stdcall
+pthread32_start(void* p)
+{
+    pthread32_start_t start = *(pthread32_start_t*)p;
+
+    free(p);
+    start.routine(start.arg);
+    return 0;
+}
+
+static int
+pthread_create(pthread_t* thread, const pthread_attr_t* attr,
+               void* (*routine)(void*), void* arg)
+{
+    pthread32_start_t* start;
+
+    start = (pthread32_start_t*)malloc(sizeof(pthread32_start_t));
+    start->routine = routine;
+    start->arg = arg;
+
+    /* _beginthreadex (not CreateThread) so the C runtime is set up
+       for the new thread */
+    *thread = (HANDLE)_beginthreadex(NULL, 0, pthread32_start, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+pthread_join(pthread_t thread, void** result)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+    if (result)
+        *result = NULL;
+    return 0;
+}
+
+static int
+pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr)
+{
+    InitializeCriticalSection(mutex);
+    return 0;
+}
+
+static int
+pthread_mutex_destroy(pthread_mutex_t* mutex)
+{
+    DeleteCriticalSection(mutex);
+    return 0;
+}
+
+static int
+pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    EnterCriticalSection(mutex);
+    return 0;
+}
+
+static int
+pthread_mutex_unlock(pthread_mutex_t* mutex)
+{
+    LeaveCriticalSection(mutex);
+    return 0;
+}
+
+static int
+pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr)
+{
+    InitializeConditionVariable(cond);
+    return 0;
+}
+
+static int
+pthread_cond_destroy(pthread_cond_t* cond)
+{
+    return 0;
+}
+
+static int
+pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    return SleepConditionVariableCS(cond, mutex, INFINITE) ? 0 : -1;
+}
+
+static int
+pthread_cond_signal(pthread_cond_t* cond)
+{
+    WakeConditionVariable(cond);
+    return 0;
+}
+
+static int
+pthread_cond_broadcast(pthread_cond_t* cond)
+{
+    WakeAllConditionVariable(cond);
+    return 0;
+}
+
+#endif